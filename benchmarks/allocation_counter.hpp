@@ -0,0 +1,60 @@
+// Replaces the global operator new and delete, plain and over-aligned, with
+// versions that count what the benchmark allocates. Include it from the one
+// translation unit of a benchmark.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+namespace allocationCounter {
+// Calls to operator new
+inline std::atomic<std::size_t> allocations{0};
+// Bytes requested from operator new, freed or not
+inline std::atomic<std::size_t> allocatedBytes{0};
+// Bytes allocated and not freed yet, where the allocator tells block sizes
+// (glibc only, 0 elsewhere)
+inline std::atomic<std::size_t> liveBytes{0};
+
+inline void *track(void *p, const std::size_t size) {
+  if (!p) {
+    throw std::bad_alloc{};
+  }
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+#if defined(__GLIBC__)
+  liveBytes.fetch_add(malloc_usable_size(p), std::memory_order_relaxed);
+#endif
+  return p;
+}
+
+inline void release(void *p) noexcept {
+#if defined(__GLIBC__)
+  if (p) {
+    liveBytes.fetch_sub(malloc_usable_size(p), std::memory_order_relaxed);
+  }
+#endif
+  std::free(p);
+}
+} // namespace allocationCounter
+
+void *operator new(std::size_t size) { return allocationCounter::track(std::malloc(size == 0 ? 1 : size), size); }
+
+// Over-aligned storage, such as the index groups, goes through these
+void *operator new(std::size_t size, std::align_val_t align) {
+  const auto alignment = std::max(static_cast<std::size_t>(align), sizeof(void *));
+  const auto rounded = (std::max<std::size_t>(size, 1) + alignment - 1) / alignment * alignment;
+  return allocationCounter::track(std::aligned_alloc(alignment, rounded), size);
+}
+
+void operator delete(void *p) noexcept { allocationCounter::release(p); }
+void operator delete(void *p, std::size_t) noexcept { allocationCounter::release(p); }
+void operator delete(void *p, std::align_val_t) noexcept { allocationCounter::release(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept { allocationCounter::release(p); }
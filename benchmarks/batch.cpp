@@ -0,0 +1,49 @@
+// Lookups of random cached keys in a cache far larger than the last level
+// cache: one call per key against get_many, which prefetches the index
+// buckets and slots of a group of keys before resolving them.
+
+#include <cstdint>
+#include <lru/lru.hpp>
+#include <nanobench.h>
+#include <string>
+#include <vector>
+
+std::uint64_t work(const std::uint64_t x) { return x * 0x9E3779B97F4A7C15ULL; }
+
+int main() {
+  constexpr std::size_t capacity = 1 << 23;
+  constexpr std::size_t lookups = 1 << 20;
+
+  // CLOCK hits only touch their own slot; an LRU hit also relinks the
+  // neighbours in the recency list, which no prefetch can anticipate
+  auto cache = lru::make_cache<&work, lru::policy::clock>(capacity);
+  for (std::uint64_t i = 0; i < capacity; ++i) {
+    cache(i);
+  }
+  ankerl::nanobench::Rng rng(42);
+  std::vector<std::uint64_t> keys(lookups);
+  for (auto &key : keys) {
+    key = rng.bounded(capacity);
+  }
+  std::vector<std::uint64_t> values(lookups);
+
+  ankerl::nanobench::Bench bench;
+  bench.title("Random hits, " + std::to_string(capacity) + " entries").unit("op").batch(lookups).epochs(3);
+
+  bench.run("operator()", [&] {
+    for (std::size_t i = 0; i < lookups; ++i) {
+      values[i] = cache(keys[i]);
+    }
+    ankerl::nanobench::doNotOptimizeAway(values.data());
+  });
+  for (const std::size_t block : {16u, 256u, 4096u}) {
+    bench.run("get_many, " + std::to_string(block) + " keys per call", [&] {
+      for (std::size_t i = 0; i < lookups; i += block) {
+        cache.get_many(keys.begin() + i, keys.begin() + i + block, values.begin() + i);
+      }
+      ankerl::nanobench::doNotOptimizeAway(values.data());
+    });
+  }
+
+  return 0;
+}
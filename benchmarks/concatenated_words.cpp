@@ -21,7 +21,8 @@
  * Two namespaces are provided:
  * 1. `naive`: Implements a basic recursive solution without memoization.
  * 2. `caching`: Implements the same recursive logic but uses `lru::Cache`
- * for memoization to avoid redundant computations.
+ * for memoization to avoid redundant computations. It is templated on the
+ * eviction policy, and is run with both strict LRU and CLOCK.
  *
  * `naive` Namespace:
  * - `canForm(s, wordSet)`: Recursively checks if string `s` can be formed by
@@ -33,26 +34,19 @@
  * time complexity in the worst case.
  *
  * `caching` Namespace:
- * - Key Improvement: Uses `lru::Cache` to memoize the results of `canForm`.
- * - `lru::Cache cache(canForm, 16384);`:
- * - This line initializes an LRU (Least Recently Used) cache.
- * - It wraps the `caching::canForm` function.
- * - `16384` is the maximum number of results the cache will store. When the
- * cache is full, the least recently used entry is removed to make space.
- * - When `cache(substring)` is called:
- * 1. It checks if the result for `substring` is already in the cache.
- * 2. If yes, it returns the cached result immediately.
- * 3. If no, it calls the original `caching::canForm(substring)`, stores the
- * result in the cache associated with `substring`, and then returns the result.
+ * - Key Improvement: Memoizes `canForm` with `lru::make_recursive_cache`.
+ * - The cache wraps a lambda that captures `wordSet` by reference, so the
+ * dictionary travels with the cache instead of living in a global.
+ * - The lambda's first parameter is a handle to the cache itself, and the
+ * recursive call is made through it: `canForm(suffix)` looks the suffix up in
+ * the cache and only recurses on a miss.
+ * - When the cache is full, the entry chosen by the eviction policy is removed
+ * to make space, even while outer calls are still computing.
  * - Emulation: This effectively emulates the behavior of Python's
- * `@functools.cache` or `@lru_cache` decorators, providing automatic
- * memoization for the function.
- * - `canForm(s)`: The logic is the same as the naive version, but the recursive
- * call is made via the cache: `cache(suffix)` instead of `canForm(suffix)`.
- * - `wordSet`: Is a global variable within the namespace, accessible by the
- * `canForm` function when invoked through the cache wrapper.
+ * `@functools.cache` or `@lru_cache` decorators on a recursive function.
  * - `findAllConcatenatedWordsInADict`: Similar structure to the naive version
- * but uses `cache(word)` to check each word, benefiting from memoization.
+ * but uses the cache to check each word, benefiting from memoization. It is
+ * templated on the eviction policy, and is run with both strict LRU and CLOCK.
  *
  */
 
@@ -126,40 +120,6 @@ findAllConcatenatedWordsInADict(const std::vector<std::string> &words) {
 
 namespace caching {
 
-// forward declaration to allow  canForm to use the cache instead of calling
-// itself recursively
-bool canForm(std::string_view s);
-auto cache = lru::make_cache(canForm);
-
-std::unordered_set<std::string_view> wordSet;
-bool canForm(std::string_view s) {
-  // Base case for recursion: an empty string cannot be formed by non-empty
-  // words.
-  if (s.empty()) {
-    return false;
-  }
-  // Iterate through all possible split points i (1 to length-1)
-  // This creates non-empty prefix and suffix.
-  for (int i = 1; i < s.length(); ++i) {
-    std::string_view prefix = s.substr(0, i);
-    std::string_view suffix = s.substr(i);
-
-    // Check if the prefix exists in the dictionary
-    if (wordSet.count(prefix)) {
-      // If prefix is valid, check the suffix:
-      // It must EITHER be a word itself...
-      // OR it must be recursively formable.
-      // Pass wordSet down the recursive call.
-      if (wordSet.count(suffix) || cache(suffix)) {
-        // Found a valid segmentation.
-        return true;
-      }
-    }
-  }
-
-  return false;
-}
-
 /**
  * @brief Finds all concatenated words in a dictionary.
  *
@@ -167,6 +127,7 @@ bool canForm(std::string_view s) {
  * @return A list of words from the input that are concatenations of >= 2 other
  * words from the input.
  */
+template <typename Policy>
 std::vector<std::string_view>
 findAllConcatenatedWordsInADict(const std::vector<std::string> &words) {
   if (words.empty()) {
@@ -174,7 +135,32 @@ findAllConcatenatedWordsInADict(const std::vector<std::string> &words) {
   }
 
   // Create an unordered_set for O(1) average time word lookups.
-  wordSet = std::unordered_set<std::string_view>(words.begin(), words.end());
+  const std::unordered_set<std::string_view> wordSet(words.begin(), words.end());
+
+  // Same logic as naive::canForm, but the recursive call goes through the
+  // cache, and the word set is captured instead of passed down.
+  auto canForm = lru::make_recursive_cache<Policy>(
+      [&wordSet](lru::recursive<bool(std::string_view)> &canForm, std::string_view s) {
+        // Base case for recursion: an empty string cannot be formed by
+        // non-empty words.
+        if (s.empty()) {
+          return false;
+        }
+        // Iterate through all possible split points i (1 to length-1)
+        // This creates non-empty prefix and suffix.
+        for (std::size_t i = 1; i < s.length(); ++i) {
+          std::string_view prefix = s.substr(0, i);
+          std::string_view suffix = s.substr(i);
+
+          // If prefix is valid, the suffix must EITHER be a word itself...
+          // OR it must be recursively formable.
+          if (wordSet.count(prefix) && (wordSet.count(suffix) || canForm(suffix))) {
+            // Found a valid segmentation.
+            return true;
+          }
+        }
+        return false;
+      });
 
   std::vector<std::string_view> result;
 
@@ -185,9 +171,8 @@ findAllConcatenatedWordsInADict(const std::vector<std::string> &words) {
       continue;
     }
 
-    // Check if the current word can be formed by calling the helper function.
-    // Pass the wordSet to the top-level call.
-    if (cache(word)) {
+    // Check if the current word can be formed through the cache.
+    if (canForm(word)) {
       result.push_back(word);
     }
   }
@@ -206,13 +191,22 @@ int main() {
 
   {
     const auto start = std::chrono::high_resolution_clock::now();
-    doNotOptimizeAway(caching::findAllConcatenatedWordsInADict(test_words));
+    doNotOptimizeAway(caching::findAllConcatenatedWordsInADict<lru::policy::lru>(test_words));
     const auto end = std::chrono::high_resolution_clock::now();
 
     std::chrono::duration<double> elapsed_seconds = end - start;
     std::cout << "caching elapsed time: " << elapsed_seconds.count() << "s\n";
   }
 
+  {
+    const auto start = std::chrono::high_resolution_clock::now();
+    doNotOptimizeAway(caching::findAllConcatenatedWordsInADict<lru::policy::clock>(test_words));
+    const auto end = std::chrono::high_resolution_clock::now();
+
+    std::chrono::duration<double> elapsed_seconds = end - start;
+    std::cout << "caching (CLOCK) elapsed time: " << elapsed_seconds.count() << "s\n";
+  }
+
   {
     const auto start = std::chrono::high_resolution_clock::now();
     doNotOptimizeAway(naive::findAllConcatenatedWordsInADict(test_words));
@@ -0,0 +1,70 @@
+// Read-heavy Zipf workload on 1..N threads: one lru::Cache behind a single
+// mutex against the sharded lru::ConcurrentCache, with strict LRU and CLOCK,
+// and against lru::TieredCache serving hot keys from per-thread tiers.
+
+#include "workloads.hpp"
+#include <algorithm>
+#include <lru/concurrent.hpp>
+#include <lru/tiered.hpp>
+#include <mutex>
+#include <nanobench.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+std::uint64_t work(const std::uint64_t x) { return x * 0x9E3779B97F4A7C15ULL; }
+
+template <typename Lookup>
+void runThreads(const unsigned threads, const std::vector<std::vector<std::uint64_t>> &keys, Lookup &lookup) {
+  std::vector<std::thread> pool;
+  for (unsigned t = 0; t < threads; ++t) {
+    pool.emplace_back([&, t] {
+      for (const auto key : keys[t]) {
+        ankerl::nanobench::doNotOptimizeAway(lookup(key));
+      }
+    });
+  }
+  for (auto &thread : pool) {
+    thread.join();
+  }
+}
+
+int main() {
+  constexpr std::size_t universe = 1 << 20;
+  constexpr std::size_t capacity = 1 << 16;
+  constexpr std::size_t opsPerThread = 1 << 18;
+  const unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+  std::vector<std::vector<std::uint64_t>> keys;
+  for (unsigned t = 0; t < maxThreads; ++t) {
+    keys.push_back(zipfKeys(universe, 0.99, opsPerThread, t + 1));
+  }
+
+  ankerl::nanobench::Bench bench;
+  bench.title("Zipf(0.99) lookups, " + std::to_string(capacity) + " entries").unit("op").epochs(3);
+
+  for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+    bench.batch(threads * opsPerThread);
+
+    lru::Cache<std::uint64_t, std::uint64_t> cache(work, capacity);
+    std::mutex mutex;
+    auto locked = [&](const std::uint64_t key) {
+      std::lock_guard<std::mutex> lock{mutex};
+      return cache(key);
+    };
+    bench.run("single mutex, " + std::to_string(threads) + " threads", [&] { runThreads(threads, keys, locked); });
+
+    auto sharded = lru::make_concurrent_cache(work, capacity);
+    bench.run("sharded, " + std::to_string(threads) + " threads", [&] { runThreads(threads, keys, sharded); });
+
+    // Hits take the shard lock in shared mode and only set a reference bit
+    auto clock = lru::make_concurrent_cache<lru::policy::clock>(work, capacity);
+    bench.run("sharded CLOCK, " + std::to_string(threads) + " threads", [&] { runThreads(threads, keys, clock); });
+
+    // The 256 hottest keys of each thread never touch a shared cache line
+    auto tiered = lru::make_tiered_cache(work, capacity, 256, 2);
+    bench.run("tiered, " + std::to_string(threads) + " threads", [&] { runThreads(threads, keys, tiered); });
+  }
+
+  return 0;
+}
@@ -1,6 +1,7 @@
 // Description: Example of a good use of the library: the function is worth caching.
 
 #include "lru/lru.hpp"
+#include "lru/static_cache.hpp"
 #include <nanobench.h>
 
 // naive recursive fibonacci implementation
@@ -21,6 +22,8 @@ int main() {
 
     // Fibonacci only needs the last two values
     auto cache = lru::make_cache(fibonacci ,2);
+    auto clock_cache = lru::make_cache<lru::policy::clock>(fibonacci, 2);
+    auto static_cache = lru::make_static_cache<2, fibonacci>();
 
 
     bench.run("Direct evaluation", [&]() {
@@ -35,6 +38,19 @@ int main() {
         }
     });
 
+    // Hits only set a reference bit instead of splicing the recency list
+    bench.run("Cache evaluation (CLOCK)", [&]() {
+        for (auto i = 0; i < evals; ++i) {
+            clock_cache(30);
+        }
+    });
+
+    // Two inline entries scanned linearly, no index or function object
+    bench.run("Cache evaluation (StaticCache)", [&]() {
+        for (auto i = 0; i < evals; ++i) {
+            static_cache(30);
+        }
+    });
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,159 @@
+// Compares the flat slot layout of lru::Cache against the previous list + map
+// layout (LegacyCache): heap bytes per cached entry and latency of a hit, and at
+// 1M entries, where neither table fits in cache, of hits and misses.
+
+#include "allocation_counter.hpp"
+#include "legacy_cache.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <lru/lru.hpp>
+#include <memory>
+#include <nanobench.h>
+#include <string>
+#include <vector>
+
+namespace {
+using allocationCounter::allocatedBytes;
+constexpr std::size_t entries = 1 << 16;
+constexpr std::size_t large = 1 << 20;
+} // namespace
+
+int square(const int x) { return x * x; }
+
+int manyArgs(int a, double b, char c, const std::string &d, bool e, float f, long g, short h, unsigned int i,
+             unsigned long j) {
+  return a + static_cast<int>(b) + c + static_cast<int>(d.length()) + e + static_cast<int>(f) + g + h + i + j;
+}
+
+// Long enough to defeat the small string optimization
+std::string name(const int i) { return "a key that lives on the heap #" + std::to_string(i); }
+
+template <typename Make, typename Fill>
+double bytesPerEntry(const Make &make, const Fill &fill, const std::size_t entries) {
+  const auto before = allocatedBytes.load();
+  auto cache = make();
+  fill(cache);
+  return double(allocatedBytes.load() - before) / double(entries);
+}
+
+int main() {
+  using ankerl::nanobench::doNotOptimizeAway;
+
+  std::cout << "Heap bytes per entry (" << entries << " entries)\n";
+  const auto fillSquares = [&](auto &cache) {
+    for (int i = 0; i < int(entries); ++i) {
+      cache(i);
+    }
+  };
+  const auto fillManyArgs = [&](auto &cache) {
+    for (int i = 0; i < int(entries); ++i) {
+      cache(i, 2.0, 'c', name(i), true, 3.0f, 4L, 5, 6U, 7UL);
+    }
+  };
+  std::cout << "  int -> int     legacy: "
+            << bytesPerEntry([] { return std::make_unique<LegacyCache<int, int>>(square, entries); },
+                             [&](auto &cache) { fillSquares(*cache); }, entries)
+            << "  flat: "
+            << bytesPerEntry([] { return std::make_unique<lru::Cache<int, int>>(square, entries); },
+                             [&](auto &cache) { fillSquares(*cache); }, entries)
+            << '\n';
+
+  using LegacyManyArgs = LegacyCache<int, int, double, char, const std::string &, bool, float, long, short,
+                                     unsigned int, unsigned long>;
+  using FlatManyArgs = lru::Cache<int, int, double, char, const std::string &, bool, float, long, short, unsigned int,
+                                  unsigned long>;
+  std::cout << "  manyargs       legacy: "
+            << bytesPerEntry([] { return std::make_unique<LegacyManyArgs>(manyArgs, entries); },
+                             [&](auto &cache) { fillManyArgs(*cache); }, entries)
+            << "  flat: "
+            << bytesPerEntry([] { return std::make_unique<FlatManyArgs>(manyArgs, entries); },
+                             [&](auto &cache) { fillManyArgs(*cache); }, entries)
+            << '\n';
+
+  ankerl::nanobench::Bench bench;
+  bench.title("Cache hit latency").unit("hit").warmup(100).relative(true);
+
+  // Random hits over a table that does not fit in L1/L2
+  std::vector<int> order(entries);
+  ankerl::nanobench::Rng rng(42);
+  for (auto &i : order) {
+    i = int(rng.bounded(entries));
+  }
+
+  LegacyCache<int, int> legacy(square, entries);
+  lru::Cache<int, int> flat(square, entries);
+  fillSquares(legacy);
+  fillSquares(flat);
+
+  std::size_t next = 0;
+  bench.run("legacy int", [&] { doNotOptimizeAway(legacy(order[next++ % entries])); });
+  next = 0;
+  bench.run("flat int", [&] { doNotOptimizeAway(flat(order[next++ % entries])); });
+
+  std::vector<std::string> names(entries);
+  for (int i = 0; i < int(entries); ++i) {
+    names[i] = name(i);
+  }
+  LegacyManyArgs legacyManyArgs(manyArgs, entries);
+  FlatManyArgs flatManyArgs(manyArgs, entries);
+  for (int i = 0; i < int(entries); ++i) {
+    legacyManyArgs(i, 2.0, 'c', names[i], true, 3.0f, 4L, 5, 6U, 7UL);
+    flatManyArgs(i, 2.0, 'c', names[i], true, 3.0f, 4L, 5, 6U, 7UL);
+  }
+
+  next = 0;
+  bench.run("legacy manyargs", [&] {
+    const auto i = order[next++ % entries];
+    doNotOptimizeAway(legacyManyArgs(i, 2.0, 'c', names[i], true, 3.0f, 4L, 5, 6U, 7UL));
+  });
+  next = 0;
+  bench.run("flat manyargs", [&] {
+    const auto i = order[next++ % entries];
+    doNotOptimizeAway(flatManyArgs(i, 2.0, 'c', names[i], true, 3.0f, 4L, 5, 6U, 7UL));
+  });
+
+  // Every lookup misses the CPU caches: a legacy hit loads a map bucket and
+  // then its list node, a flat hit one index group (tags and buckets share a
+  // cache line) and then the slot. Misses also compute and evict.
+  ankerl::nanobench::Bench largeBench;
+  largeBench.title("Latency at 1M entries").warmup(100).relative(true);
+
+  std::vector<int> largeOrder(large);
+  for (auto &i : largeOrder) {
+    i = int(rng.bounded(large));
+  }
+  const auto fillLarge = [&](auto &cache) {
+    for (int i = 0; i < int(large); ++i) {
+      cache(i);
+    }
+  };
+  LegacyCache<int, int> legacyLarge(square, large);
+  lru::Cache<int, int> flatLarge(square, large);
+  // Same layout, on huge pages: fewer TLB misses per lookup
+  lru::huge_page_resource hugePages;
+  lru::Cache<int, int> hugeLarge(square, large, &hugePages);
+  fillLarge(legacyLarge);
+  fillLarge(flatLarge);
+  fillLarge(hugeLarge);
+
+  next = 0;
+  largeBench.unit("hit").run("legacy int hit", [&] { doNotOptimizeAway(legacyLarge(largeOrder[next++ % large])); });
+  next = 0;
+  largeBench.unit("hit").run("flat int hit", [&] { doNotOptimizeAway(flatLarge(largeOrder[next++ % large])); });
+  next = 0;
+  largeBench.unit("hit").run("flat int hit, huge pages",
+                             [&] { doNotOptimizeAway(hugeLarge(largeOrder[next++ % large])); });
+
+  // Keys cycle through 4x the capacity, so each one was evicted long ago
+  next = 0;
+  largeBench.unit("miss").run("legacy int miss", [&] {
+    doNotOptimizeAway(legacyLarge(int(large + next++ % (4 * large))));
+  });
+  next = 0;
+  largeBench.unit("miss").run("flat int miss", [&] {
+    doNotOptimizeAway(flatLarge(int(large + next++ % (4 * large))));
+  });
+
+  return 0;
+}
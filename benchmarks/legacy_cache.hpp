@@ -0,0 +1,47 @@
+// The pre-flat-layout cache: a std::list holding the entries in recency order
+// and an emhash7 map from each key to its list node. Every key is stored twice
+// and every hit chases a pointer into a separately allocated node. Kept only as
+// a baseline for the layout benchmarks.
+
+#pragma once
+
+#include <emhash/hash_table7.hpp>
+#include <functional>
+#include <list>
+#include <lru/lru.hpp>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+template <typename R, typename... Args> class LegacyCache {
+public:
+  using Function = std::function<R(Args...)>;
+  using Key = std::tuple<std::decay_t<Args>...>;
+  using MapHash = lru::detail::tuple_hash<Key>;
+  const std::size_t capacity;
+
+  explicit LegacyCache(Function func, std::size_t capacity = 1024)
+      : capacity{capacity}, func{std::move(func)}, cache_map(capacity) {}
+
+  R operator()(Args... args) {
+    Key key{args...};
+
+    if (const auto it = cache_map.find(key); it != cache_map.end()) {
+      cache_list.splice(cache_list.begin(), cache_list, it->second);
+      return cache_list.begin()->second;
+    }
+    if (cache_list.size() >= capacity) {
+      cache_map.erase(cache_list.back().first);
+      cache_list.pop_back();
+    }
+    cache_list.emplace_front(key, func(std::forward<Args>(args)...));
+    cache_map[key] = cache_list.begin();
+    return cache_list.begin()->second;
+  }
+
+private:
+  const Function func;
+  std::list<std::pair<Key, R>> cache_list;
+  using ListIt = typename decltype(cache_list)::iterator;
+  emhash7::HashMap<Key, ListIt, MapHash> cache_map;
+};
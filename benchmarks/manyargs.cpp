@@ -1,6 +1,7 @@
 #include <lru/lru.hpp>
 #include <nanobench.h>
 #include <string>
+#include <string_view>
 
 // Function with no side effects
 int exampleFunction(int a, double b, char c, const std::string &d, bool e,
@@ -11,6 +12,13 @@ int exampleFunction(int a, double b, char c, const std::string &d, bool e,
          static_cast<int>(f) + g + h + i + j;
 }
 
+// The same arguments, all trivially copyable: the key is hashed and compared
+// as packed bytes
+int trivialFunction(int a, double b, char c, unsigned char d, bool e, float f, long g, short h, unsigned int i,
+                    unsigned long j) {
+  return a + static_cast<int>(b) + c + d + e + static_cast<int>(f) + g + h + i + j;
+}
+
 int main() {
   ankerl::nanobench::Bench bench;
   bench.title("Function with No Side Effects Benchmark")
@@ -30,5 +38,21 @@ int main() {
           cache(1, 2.0, 'c', "example", true, 3.0f, 4L, 5, 6U, 7UL));
   });
 
+  // Hits look the string up in place: none of these copy it
+  const std::string name = "an example argument beyond the small string buffer";
+  const std::string_view view = name;
+  cache(1, 2.0, 'c', name, true, 3.0f, 4L, 5, 6U, 7UL);
+  bench.run("Cache Hit, long std::string", [&]() {
+      doNotOptimizeAway(cache(1, 2.0, 'c', name, true, 3.0f, 4L, 5, 6U, 7UL));
+  });
+  bench.run("Cache Hit, long std::string_view", [&]() {
+      doNotOptimizeAway(cache(1, 2.0, 'c', view, true, 3.0f, 4L, 5, 6U, 7UL));
+  });
+
+  auto trivialCache = lru::make_cache(trivialFunction);
+  bench.run("Cache Hit, trivially copyable arguments", [&]() {
+      doNotOptimizeAway(trivialCache(1, 2.0, 'c', 7, true, 3.0f, 4L, 5, 6U, 7UL));
+  });
+
   return 0;
 }
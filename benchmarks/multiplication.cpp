@@ -16,22 +16,34 @@ int main() {
   auto cache = lru::make_cache(test_function);
 
   bench.run("Cache Insertion", [&]() {
-    for (auto i = 0; i < cache.capacity; ++i) {
+    for (auto i = 0; i < cache.capacity(); ++i) {
       cache(i);
     }
   });
 
   bench.run("Cache Hit", [&]() {
-    for (auto i = 0; i < cache.capacity; ++i) {
+    for (auto i = 0; i < cache.capacity(); ++i) {
       cache(i);
     }
   });
 
   bench.run("Cache Miss", [&]() {
-    for (auto i = int(cache.capacity); i < cache.capacity * 2; ++i) {
+    for (auto i = int(cache.capacity()); i < cache.capacity() * 2; ++i) {
       cache(i);
     }
   });
 
+  // Cycling over twice the capacity misses every time; the function is either
+  // type-erased or fixed at compile time and inlined into the miss path
+  const auto missAll = [](auto &cache) {
+    for (auto i = 0; i < int(2 * cache.capacity()); ++i) {
+      ankerl::nanobench::doNotOptimizeAway(cache(i));
+    }
+  };
+  lru::Cache<int, int> erased(test_function);
+  bench.run("Cache Miss, std::function", [&]() { missAll(erased); });
+  auto constant = lru::make_cache<&test_function>();
+  bench.run("Cache Miss, make_cache<&test_function>", [&]() { missAll(constant); });
+
   return 0;
 }
\ No newline at end of file
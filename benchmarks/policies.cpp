@@ -0,0 +1,65 @@
+// Hit ratio and lookup cost of each eviction policy, on a skewed Zipf stream
+// and on the same stream interrupted by long one-off scans.
+
+#include "workloads.hpp"
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <lru/lru.hpp>
+#include <nanobench.h>
+#include <string>
+#include <vector>
+
+namespace {
+constexpr std::size_t universe = 1 << 20;
+constexpr std::size_t capacity = 1 << 14;
+constexpr std::size_t lookups = 1 << 21;
+
+std::uint64_t misses = 0;
+} // namespace
+
+std::uint64_t work(const std::uint64_t x) {
+  ++misses;
+  return x * 0x9E3779B97F4A7C15ULL;
+}
+
+template <typename Policy>
+void runPolicy(ankerl::nanobench::Bench &bench, const std::string &name, const std::vector<std::uint64_t> &keys) {
+  // Hit ratio over one cold-started pass
+  {
+    auto cache = lru::make_cache<Policy>(work, capacity);
+    misses = 0;
+    for (const auto key : keys) {
+      ankerl::nanobench::doNotOptimizeAway(cache(key));
+    }
+    std::cout << std::setw(12) << name << " hit ratio " << std::fixed << std::setprecision(4)
+              << 1.0 - double(misses) / double(keys.size()) << '\n';
+  }
+
+  auto cache = lru::make_cache<Policy>(work, capacity);
+  bench.run(name, [&] {
+    for (const auto key : keys) {
+      ankerl::nanobench::doNotOptimizeAway(cache(key));
+    }
+  });
+}
+
+void runAll(const std::string &title, const std::vector<std::uint64_t> &keys) {
+  std::cout << '\n' << title << '\n';
+  ankerl::nanobench::Bench bench;
+  bench.title(title).unit("op").batch(keys.size()).epochs(3);
+
+  runPolicy<lru::policy::lru>(bench, "lru", keys);
+  runPolicy<lru::policy::clock>(bench, "clock", keys);
+  runPolicy<lru::policy::slru>(bench, "slru", keys);
+  runPolicy<lru::policy::s3fifo>(bench, "s3fifo", keys);
+  runPolicy<lru::policy::w_tinylfu>(bench, "w_tinylfu", keys);
+}
+
+int main() {
+  runAll("Zipf(0.99), " + std::to_string(capacity) + " entries", zipfKeys(universe, 0.99, lookups, 1));
+  // Every 64k lookups, a scan four times the cache size
+  runAll("Zipf(0.99) + scans, " + std::to_string(capacity) + " entries",
+         scanMixKeys(universe, 0.99, lookups, 1 << 16, 4 * capacity, 2));
+  return 0;
+}
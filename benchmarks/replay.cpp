@@ -0,0 +1,261 @@
+// Miss-ratio curves of every eviction policy, from traces of key hashes (see
+// lru/trace.hpp) and in a single pass over each trace. The LRU curve comes
+// from stack distances (Mattson et al.), which give the hits of every
+// capacity at once; the other policies have no stack property and are run as
+// one miniature cache per capacity (Waldspurger et al., ATC'17). Both sample
+// keys by hash (SHARDS), so a trace of any length replays in bounded memory.
+// Long traces sample the stack distances too, which blurs the LRU stack
+// curve below about 1 / rate entries; the miniature LRU column stays exact
+// up to miniatureEntries.
+//
+// Usage: replay [trace...]
+// Without a trace, one is recorded from a Zipf workload interrupted by scans.
+
+#include "workloads.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <lru/lru.hpp>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+constexpr std::size_t minCapacity = 1 << 6;
+constexpr std::size_t maxCapacity = 1 << 24;
+// Entries in a miniature cache; smaller capacities are simulated in full
+constexpr std::size_t miniatureEntries = 1 << 13;
+// Sampled references the stack distances are computed over, at most
+constexpr double stackReferences = 1 << 22;
+// Sampling compares the low bits of the spread hash against rate * modulus
+constexpr std::uint64_t modulus = 1 << 24;
+
+// The capacities of the curves: powers of two
+std::vector<std::size_t> capacities() {
+  std::vector<std::size_t> grid;
+  for (auto capacity = minCapacity; capacity <= maxCapacity; capacity *= 2) {
+    grid.push_back(capacity);
+  }
+  return grid;
+}
+
+// Remixes a recorded hash so that its low bits are uniform whatever the key
+// hash was (murmur3's finalizer)
+std::uint64_t spread(std::uint64_t hash) {
+  hash ^= hash >> 33;
+  hash *= 0xFF51AFD7ED558CCDULL;
+  hash ^= hash >> 33;
+  hash *= 0xC4CEB9FE1A85EC53ULL;
+  return hash ^ (hash >> 33);
+}
+
+// A key is sampled at rate `rate` when its spread hash is below the threshold
+std::uint64_t thresholdOf(const double rate) { return std::max<std::uint64_t>(1, std::uint64_t(rate * modulus)); }
+bool sampled(const std::uint64_t key, const std::uint64_t threshold) { return (key & (modulus - 1)) < threshold; }
+
+// Miss ratio of a sample, with the SHARDS-adj correction: a few hot keys
+// make the number of sampled references stray from its expectation, and the
+// difference is mostly hits to those keys, so it is counted as hits
+double adjusted(const std::uint64_t misses, const std::uint64_t references, const double expected) {
+  if (references == 0) {
+    return 0.0;
+  }
+  return std::min(1.0, double(misses) / std::max(expected, double(misses)));
+}
+
+// LRU hit counts of every capacity from the stack distance of each sampled
+// reference: the number of distinct keys referenced since the same key was.
+// A Fenwick tree over the reference times marks the last reference of every
+// key, so a distance is a prefix sum, and distances scale back by 1 / rate.
+class StackDistances {
+public:
+  StackDistances(const double rate, std::vector<std::size_t> grid)
+      : threshold{thresholdOf(rate)}, rate{double(threshold) / modulus}, grid{std::move(grid)},
+        hitsAt(this->grid.size()), tree(1024) {}
+
+  void access(const std::uint64_t key) {
+    ++lookups;
+    if (!sampled(key, threshold)) {
+      return;
+    }
+    ++references;
+    const auto time = ++now;
+    if (time >= tree.size()) {
+      grow();
+    }
+    const auto [last, cold] = lastReference.try_emplace(key, time);
+    if (!cold) {
+      const auto distance = prefix(time - 1) - prefix(last->second) + 1;
+      add(last->second, -1);
+      last->second = time;
+      // Hit in every capacity from the first one holding `distance` keys
+      const auto scaled = static_cast<std::size_t>(double(distance) / rate);
+      const auto at = std::lower_bound(grid.begin(), grid.end(), scaled) - grid.begin();
+      if (static_cast<std::size_t>(at) < grid.size()) {
+        ++hitsAt[at];
+      }
+    }
+    add(time, 1);
+  }
+
+  double missRatio(const std::size_t at) const {
+    std::uint64_t hits = 0;
+    for (std::size_t i = 0; i <= at; ++i) {
+      hits += hitsAt[i];
+    }
+    return adjusted(references - hits, references, lookups * rate);
+  }
+
+private:
+  // Doubling keeps the nodes below the old size, which cover the same
+  // ranges; nodes above it only cover unused times, except the new root
+  void grow() {
+    const auto size = tree.size();
+    tree.resize(2 * size);
+    tree[size] = prefix(size - 1);
+  }
+
+  void add(std::size_t time, const std::int64_t delta) {
+    for (; time < tree.size(); time += time & (~time + 1)) {
+      tree[time] += delta;
+    }
+  }
+
+  std::int64_t prefix(std::size_t time) const {
+    std::int64_t sum = 0;
+    for (; time > 0; time -= time & (~time + 1)) {
+      sum += tree[time];
+    }
+    return sum;
+  }
+
+  const std::uint64_t threshold;
+  const double rate;
+  const std::vector<std::size_t> grid;
+  std::vector<std::uint64_t> hitsAt;
+  std::vector<std::int64_t> tree;
+  std::unordered_map<std::uint64_t, std::size_t> lastReference;
+  std::size_t now = 0;
+  std::uint64_t lookups = 0;
+  std::uint64_t references = 0;
+};
+
+// The function of a miniature cache only counts its calls
+struct CountMisses {
+  std::uint64_t *misses;
+  bool operator()(std::uint64_t) const {
+    ++*misses;
+    return true;
+  }
+};
+
+// A cache of `capacity` entries simulated on the keys sampled at rate
+// miniatureEntries / capacity, with as many fewer entries
+template <typename Policy> class Miniature {
+public:
+  explicit Miniature(const std::size_t capacity)
+      : threshold{thresholdOf(std::min(1.0, double(miniatureEntries) / double(capacity)))},
+        cache{CountMisses{&misses},
+              std::max<std::size_t>(1, static_cast<std::size_t>(double(capacity) * threshold / modulus))} {}
+
+  void access(const std::uint64_t key) {
+    ++lookups;
+    if (sampled(key, threshold)) {
+      ++references;
+      cache(key);
+    }
+  }
+
+  double missRatio() const { return adjusted(misses, references, double(lookups) * threshold / modulus); }
+
+private:
+  const std::uint64_t threshold;
+  std::uint64_t misses = 0;
+  std::uint64_t lookups = 0;
+  std::uint64_t references = 0;
+  lru::BasicCache<bool(std::uint64_t), Policy, lru::callable<CountMisses>> cache;
+};
+
+// The miniatures of one policy, one per capacity
+template <typename Policy> class Curve {
+public:
+  explicit Curve(std::vector<std::size_t> const &grid) {
+    for (const auto capacity : grid) {
+      miniatures.push_back(std::make_unique<Miniature<Policy>>(capacity));
+    }
+  }
+
+  void access(const std::uint64_t key) {
+    for (auto &miniature : miniatures) {
+      miniature->access(key);
+    }
+  }
+
+  double missRatio(const std::size_t at) const { return miniatures[at]->missRatio(); }
+
+private:
+  std::vector<std::unique_ptr<Miniature<Policy>>> miniatures;
+};
+
+void replay(const std::string &path) {
+  const auto start = std::chrono::steady_clock::now();
+  lru::trace_reader reader{path};
+  const auto grid = capacities();
+  const auto rate = std::min(1.0, stackReferences / double(std::max<std::uint64_t>(reader.size(), 1)));
+  StackDistances stack{rate, grid};
+  std::tuple<Curve<lru::policy::lru>, Curve<lru::policy::clock>, Curve<lru::policy::slru>,
+             Curve<lru::policy::s3fifo>, Curve<lru::policy::w_tinylfu>>
+      curves{grid, grid, grid, grid, grid};
+
+  std::vector<std::uint64_t> chunk(1 << 16);
+  while (const auto count = reader.read(chunk.data(), chunk.size())) {
+    for (std::size_t i = 0; i < count; ++i) {
+      const auto key = spread(chunk[i]);
+      stack.access(key);
+      std::apply([key](auto &...curve) { (curve.access(key), ...); }, curves);
+    }
+  }
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  std::cout << '\n'
+            << path << ": " << reader.size() << " lookups, stack distances sampled at " << rate << ", replayed in "
+            << std::fixed << std::setprecision(2) << elapsed.count() << "s\n";
+  std::cout << std::setw(10) << "capacity" << std::setw(12) << "lru (stack)" << std::setw(10) << "lru" << std::setw(10)
+            << "clock" << std::setw(10) << "slru" << std::setw(10) << "s3fifo" << std::setw(10) << "w_tinylfu"
+            << "   miss ratio\n";
+  std::cout << std::setprecision(4);
+  for (std::size_t at = 0; at < grid.size(); ++at) {
+    std::cout << std::setw(10) << grid[at] << std::setw(12) << stack.missRatio(at);
+    std::apply([at](auto const &...curve) { ((std::cout << std::setw(10) << curve.missRatio(at)), ...); }, curves);
+    std::cout << '\n';
+  }
+}
+
+// Records the lookups of a cache serving a Zipf(0.99) stream over 2^20 keys,
+// interrupted every 2^18 lookups by a scan of 2^16 keys never seen again
+std::string recordExample() {
+  const auto path = (std::filesystem::temp_directory_path() / "lru_replay_example.trace").string();
+  auto cache = lru::make_cache<lru::traced>([](const std::uint64_t x) { return x * 0x9E3779B97F4A7C15ULL; }, 1 << 14);
+  lru::trace_writer writer{path};
+  cache.record_to(&writer);
+  for (const auto key : scanMixKeys(1 << 20, 0.99, 1 << 22, 1 << 18, 1 << 16, 1)) {
+    ankerl::nanobench::doNotOptimizeAway(cache(key));
+  }
+  cache.record_to(nullptr);
+  return path;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    replay(recordExample());
+  }
+  for (int i = 1; i < argc; ++i) {
+    replay(argv[i]);
+  }
+}
@@ -0,0 +1,48 @@
+// Warm start: loading a million-entry snapshot against refilling the cache
+// through the function, here a cheap one; real functions only widen the gap.
+
+#include <cstdint>
+#include <filesystem>
+#include <lru/lru.hpp>
+#include <nanobench.h>
+#include <string>
+
+namespace {
+constexpr std::size_t entries = 1 << 20;
+} // namespace
+
+std::uint64_t work(const std::uint64_t x) {
+  auto h = x;
+  for (int round = 0; round < 16; ++round) {
+    h = (h ^ (h >> 31)) * 0x9E3779B97F4A7C15ULL;
+  }
+  return h;
+}
+
+int main() {
+  const auto path = (std::filesystem::temp_directory_path() / "lru_snapshot_benchmark.snapshot").string();
+  auto warm = lru::make_cache(work, entries);
+  for (std::uint64_t key = 0; key < entries; ++key) {
+    warm(key);
+  }
+
+  ankerl::nanobench::Bench bench;
+  bench.title(std::to_string(entries) + " entries").unit("entry").batch(entries).epochs(5).epochIterations(1);
+
+  bench.run("save", [&] { warm.save(path); });
+
+  bench.run("load", [&] {
+    auto cache = lru::make_cache(work, entries);
+    cache.load(path);
+    ankerl::nanobench::doNotOptimizeAway(cache.weight());
+  });
+
+  bench.run("recompute", [&] {
+    auto cache = lru::make_cache(work, entries);
+    for (std::uint64_t key = 0; key < entries; ++key) {
+      ankerl::nanobench::doNotOptimizeAway(cache(key));
+    }
+  });
+
+  std::filesystem::remove(path);
+}
@@ -0,0 +1,203 @@
+// Sweep of the default cache over key distributions, capacities and key
+// types. For each point it reports ns/op (nanobench), the hit ratio,
+// allocations per lookup, the heap the cache holds (glibc only) and the
+// resident set of the process, all measured on a cache warmed up with one
+// stream of keys twice as long as the measured one.
+//
+// Usage: suite [--max-capacity N] [--json FILE]
+// The nanobench results are written as JSON to FILE (suite.json by default)
+// for tracking regressions.
+
+#include "allocation_counter.hpp"
+#include "workloads.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <lru/lru.hpp>
+#include <memory>
+#include <nanobench.h>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+namespace {
+using allocationCounter::allocations;
+using allocationCounter::liveBytes;
+std::uint64_t misses = 0;
+
+constexpr std::size_t minCapacity = 1 << 6;
+// String keys live in a table of the whole universe, which is bounded here
+constexpr std::size_t maxStringCapacity = 1 << 20;
+// Keys drawn from a universe this many times larger than the cache
+constexpr std::size_t universePerEntry = 4;
+// Measured lookups, after twice as many to warm the cache up
+constexpr std::size_t minLookups = 1 << 21;
+
+// Resident set size of the process, 0 where it is not known
+std::size_t residentBytes() {
+#if defined(__linux__)
+  std::ifstream statm("/proc/self/statm");
+  std::size_t total = 0, resident = 0;
+  statm >> total >> resident;
+  return resident * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#else
+  return 0;
+#endif
+}
+
+struct Distribution {
+  std::string name;
+  std::function<std::vector<std::uint64_t>(std::size_t universe, std::size_t count)> keys;
+};
+
+const std::vector<Distribution> distributions = {
+    {"uniform", [](auto universe, auto count) { return uniformKeys(universe, count, 1); }},
+    {"zipf(0.8)", [](auto universe, auto count) { return zipfKeys(universe, 0.8, count, 2); }},
+    {"zipf(1.0)", [](auto universe, auto count) { return zipfKeys(universe, 1.0, count, 3); }},
+    {"zipf(1.2)", [](auto universe, auto count) { return zipfKeys(universe, 1.2, count, 4); }},
+    // Zipf(0.99) over half the universe, with a scan of as many keys as the
+    // cache holds every 4 capacities of lookups. Scans run through the
+    // other half, which is twice the capacity, so no scanned key is still
+    // cached when the scans wrap around.
+    {"scan", [](auto universe, auto count) {
+       const auto capacity = universe / universePerEntry;
+       const auto half = universe / 2;
+       auto keys = scanMixKeys(half, 0.99, count, 4 * capacity, capacity, 5);
+       for (auto &key : keys) {
+         key = key < half ? key : half + (key - half) % half;
+       }
+       return keys;
+     }},
+    // A hot set half the capacity, moving every 8 capacities of lookups
+    {"hot-set shift", [](auto universe, auto count) {
+       const auto capacity = universe / universePerEntry;
+       return hotSetShiftKeys(universe, std::max<std::size_t>(capacity / 2, 1), count, 8 * capacity, 6);
+     }},
+};
+
+std::uint64_t intWork(const std::uint64_t x) {
+  ++misses;
+  return x * 0x9E3779B97F4A7C15ULL;
+}
+
+int tupleWork(int a0, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8, int a9) {
+  ++misses;
+  return a0 ^ a1 ^ a2 ^ a3 ^ a4 ^ a5 ^ a6 ^ a7 ^ a8 ^ a9;
+}
+
+std::size_t stringWork(const std::string &s) {
+  ++misses;
+  return s.size();
+}
+
+// The lookups of one pass, with keys of each type built from the stream
+struct IntKeys {
+  static constexpr const char *name = "int";
+  auto make(const std::size_t capacity) const { return lru::make_cache(intWork, capacity); }
+  template <typename Cache> auto lookup(Cache &cache, const std::uint64_t key) const { return cache(key); }
+};
+
+struct TupleKeys {
+  static constexpr const char *name = "10 ints";
+  auto make(const std::size_t capacity) const { return lru::make_cache(tupleWork, capacity); }
+  template <typename Cache> auto lookup(Cache &cache, const std::uint64_t key) const {
+    const auto k = static_cast<int>(key);
+    return cache(k, k + 1, k + 2, k + 3, k + 4, k + 5, k + 6, k + 7, k + 8, k + 9);
+  }
+};
+
+// Keys longer than the small string buffer, so a copy allocates
+struct StringKeys {
+  static constexpr const char *name = "string";
+  std::vector<std::string> table;
+
+  explicit StringKeys(const std::size_t universe) {
+    table.reserve(universe);
+    for (std::size_t i = 0; i < universe; ++i) {
+      table.push_back("benchmark-key-" + std::to_string(i));
+    }
+  }
+
+  auto make(const std::size_t capacity) const { return lru::make_cache(stringWork, capacity); }
+  template <typename Cache> auto lookup(Cache &cache, const std::uint64_t key) const { return cache(table[key]); }
+};
+
+template <typename Keys>
+void run(ankerl::nanobench::Bench &bench, const std::string &distribution, const Keys &keyType,
+         const std::size_t capacity, const std::vector<std::uint64_t> &keys) {
+  const std::size_t before = liveBytes;
+  auto cache = keyType.make(capacity);
+  const auto pass = [&](const std::size_t from, const std::size_t to) {
+    for (auto i = from; i < to; ++i) {
+      ankerl::nanobench::doNotOptimizeAway(keyType.lookup(cache, keys[i]));
+    }
+  };
+  const auto measured = keys.size() / 3;
+  pass(0, keys.size() - measured);
+  const auto cacheBytes = liveBytes - before;
+  const auto rss = residentBytes();
+
+  // Timed once, a repeat would find the keys it just cached
+  misses = 0;
+  allocations = 0;
+  const auto name = distribution + ", " + Keys::name + ", " + std::to_string(capacity);
+  bench.batch(measured).run(name, [&] { pass(keys.size() - measured, keys.size()); });
+  const auto nanos = bench.results().back().median(ankerl::nanobench::Result::Measure::elapsed) * 1e9;
+  const auto hitRatio = 1.0 - double(misses) / double(measured);
+  const auto allocationsPerOp = double(allocations) / double(measured);
+
+  std::cout << std::setw(14) << distribution << std::setw(9) << Keys::name << std::setw(10) << capacity
+            << std::fixed << std::setprecision(1) << std::setw(9) << nanos << std::setprecision(4) << std::setw(10)
+            << hitRatio << std::setw(11) << allocationsPerOp << std::setprecision(1) << std::setw(10)
+            << double(cacheBytes) / (1 << 20) << std::setw(10) << double(rss) / (1 << 20) << '\n';
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  std::size_t maxCapacity = 1 << 24;
+  std::string json = "suite.json";
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const std::string option = argv[i];
+    if (option == "--max-capacity") {
+      maxCapacity = std::stoull(argv[i + 1]);
+    } else if (option == "--json") {
+      json = argv[i + 1];
+    } else {
+      std::cerr << "usage: suite [--max-capacity N] [--json FILE]\n";
+      return 1;
+    }
+  }
+
+  ankerl::nanobench::Bench bench;
+  bench.title("lru::Cache sweep").unit("op").epochs(1).epochIterations(1).output(nullptr);
+
+  std::cout << std::setw(14) << "distribution" << std::setw(9) << "key" << std::setw(10) << "capacity"
+            << std::setw(9) << "ns/op" << std::setw(10) << "hit ratio" << std::setw(11) << "allocs/op"
+            << std::setw(10) << "cache MB" << std::setw(10) << "RSS MB" << '\n';
+  for (auto capacity = minCapacity; capacity <= maxCapacity; capacity *= 4) {
+    const auto universe = universePerEntry * capacity;
+    const auto count = 3 * std::max(minLookups, capacity);
+    std::unique_ptr<StringKeys> strings;
+    if (capacity <= maxStringCapacity) {
+      strings = std::make_unique<StringKeys>(universe);
+    }
+    for (const auto &distribution : distributions) {
+      const auto keys = distribution.keys(universe, count);
+      run(bench, distribution.name, IntKeys{}, capacity, keys);
+      run(bench, distribution.name, TupleKeys{}, capacity, keys);
+      if (strings) {
+        run(bench, distribution.name, *strings, capacity, keys);
+      }
+    }
+  }
+
+  std::ofstream out(json);
+  ankerl::nanobench::render(ankerl::nanobench::templates::json(), bench, out);
+}
@@ -57,24 +57,21 @@ double uniquePaths(double m, double n) {
 
 namespace caching {
 
-double factorial(double n) {
-  if (n <= 1) {
-    return 1;
-  }
-  return n * factorial(n - 1);
+// The recursive factorial, with the recursion going through the cache
+using Factorial = lru::recursive<double(double)>;
+auto makeFactorial() {
+  return lru::make_recursive_cache([](Factorial &factorial, double n) { return n <= 1 ? 1 : n * factorial(n - 1); });
 }
 
-auto cache = lru::make_cache(factorial);
-
 // Function to calculate binomial coefficient
-double binomial(double n, double k) {
-  return cache(n) / (cache(k) * cache(n - k));
+template <typename Cache> double binomial(Cache &factorial, double n, double k) {
+  return factorial(n) / (factorial(k) * factorial(n - k));
 }
 
 // Function to calculate unique paths
-double uniquePaths(double m, double n) {
+template <typename Cache> double uniquePaths(Cache &factorial, double m, double n) {
   double steps = (m - 1) + (n - 1);
-  return binomial(steps, n - 1);
+  return binomial(factorial, steps, n - 1);
 }
 } // namespace caching
 
@@ -112,7 +109,8 @@ int main() {
 
   assert(recursive::uniquePaths(m, n) == reference::uniquePaths(m, n));
   assert(iterative::uniquePaths(m, n) == reference::uniquePaths(m, n));
-  assert(caching::uniquePaths(m, n) == reference::uniquePaths(m, n));
+  auto factorial = caching::makeFactorial();
+  assert(caching::uniquePaths(factorial, m, n) == reference::uniquePaths(m, n));
 
   bench.run("reference",
             [&]() { doNotOptimizeAway(reference::uniquePaths(m, n)); });
@@ -123,7 +121,7 @@ int main() {
   bench.run("Recursive",
             [&]() { doNotOptimizeAway(recursive::uniquePaths(m, n)); });
 
-  bench.run("Cache", [&]() { doNotOptimizeAway(caching::uniquePaths(m, n)); });
+  bench.run("Cache", [&]() { doNotOptimizeAway(caching::uniquePaths(factorial, m, n)); });
 
   return 0;
 }
@@ -0,0 +1,116 @@
+// Key streams shared by the benchmarks.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <nanobench.h>
+#include <vector>
+
+// Draws ranks in [0, n) with P(k) proportional to 1 / (k + 1)^s by
+// rejection-inversion (Hörmann and Derflinger), in constant time and memory
+// whatever `n`, so universes of hundreds of millions of keys stay cheap.
+class ZipfGenerator {
+public:
+  ZipfGenerator(const std::size_t n, const double s)
+      : n{double(n)}, s{s}, hIntegralX1{hIntegral(1.5) - 1.0}, hIntegralN{hIntegral(double(n) + 0.5)},
+        threshold{2.0 - hIntegralInverse(hIntegral(2.5) - h(2.0))} {}
+
+  std::uint64_t operator()(ankerl::nanobench::Rng &rng) const {
+    for (;;) {
+      const auto u = hIntegralN + rng.uniform01() * (hIntegralX1 - hIntegralN);
+      const auto x = hIntegralInverse(u);
+      const auto k = std::clamp(std::floor(x + 0.5), 1.0, n);
+      if (k - x <= threshold || u >= hIntegral(k + 0.5) - h(k)) {
+        return static_cast<std::uint64_t>(k) - 1;
+      }
+    }
+  }
+
+private:
+  double h(const double x) const { return std::exp(-s * std::log(x)); }
+
+  double hIntegral(const double x) const {
+    const auto logX = std::log(x);
+    return helper2((1.0 - s) * logX) * logX;
+  }
+
+  double hIntegralInverse(const double x) const {
+    const auto t = std::max(x * (1.0 - s), -1.0);
+    return std::exp(helper1(t) * x);
+  }
+
+  // log1p(x) / x and expm1(x) / x, continuous through 0 (where s == 1)
+  static double helper1(const double x) {
+    return std::abs(x) > 1e-8 ? std::log1p(x) / x : 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+  }
+  static double helper2(const double x) {
+    return std::abs(x) > 1e-8 ? std::expm1(x) / x : 1.0 + x * 0.5 * (1.0 + x / 3.0 * (1.0 + 0.25 * x));
+  }
+
+  const double n;
+  const double s;
+  const double hIntegralX1;
+  const double hIntegralN;
+  const double threshold;
+};
+
+// Pre-draws `count` uniform keys in [0, universe)
+inline std::vector<std::uint64_t> uniformKeys(const std::size_t universe, const std::size_t count,
+                                              const std::uint64_t seed) {
+  ankerl::nanobench::Rng rng(seed);
+  std::vector<std::uint64_t> keys(count);
+  for (auto &key : keys) {
+    key = rng() % universe;
+  }
+  return keys;
+}
+
+// Pre-draws `count` Zipf keys so the generator stays out of the timed loop
+inline std::vector<std::uint64_t> zipfKeys(const std::size_t universe, const double s, const std::size_t count,
+                                           const std::uint64_t seed) {
+  const ZipfGenerator zipf(universe, s);
+  ankerl::nanobench::Rng rng(seed);
+  std::vector<std::uint64_t> keys(count);
+  for (auto &key : keys) {
+    key = zipf(rng);
+  }
+  return keys;
+}
+
+// Zipf keys interrupted every `period` lookups by a sequential scan of
+// `scanLength` keys that are never requested again, the pattern that flushes
+// a recency-only cache
+inline std::vector<std::uint64_t> scanMixKeys(const std::size_t universe, const double s, const std::size_t count,
+                                              const std::size_t period, const std::size_t scanLength,
+                                              const std::uint64_t seed) {
+  auto keys = zipfKeys(universe, s, count, seed);
+  std::uint64_t cold = universe;
+  for (std::size_t start = period; start < count; start += period + scanLength) {
+    const auto end = std::min(count, start + scanLength);
+    for (auto i = start; i < end; ++i) {
+      keys[i] = cold++;
+    }
+  }
+  return keys;
+}
+
+// 90% of the lookups go to a hot set of `hotSize` consecutive keys, the rest
+// anywhere in the universe; every `phase` lookups the hot set moves somewhere
+// else, and a cache has to let the old one go
+inline std::vector<std::uint64_t> hotSetShiftKeys(const std::size_t universe, const std::size_t hotSize,
+                                                  const std::size_t count, const std::size_t phase,
+                                                  const std::uint64_t seed) {
+  ankerl::nanobench::Rng rng(seed);
+  std::vector<std::uint64_t> keys(count);
+  std::uint64_t base = 0;
+  for (std::size_t i = 0; i < count; ++i) {
+    if (i % phase == 0) {
+      base = rng() % (universe - hotSize + 1);
+    }
+    keys[i] = rng() % 10 != 0 ? base + rng() % hotSize : rng() % universe;
+  }
+  return keys;
+}
@@ -0,0 +1,301 @@
+#pragma once
+
+#include "lru.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <chrono>
+#include <coroutine>
+#endif
+
+namespace lru {
+
+// Fixed set of threads running tasks in the order they were submitted. The
+// destructor runs the tasks still queued, then joins. Tasks must not throw.
+class thread_pool {
+public:
+  explicit thread_pool(const std::size_t threads = std::max(1u, std::thread::hardware_concurrency())) {
+    for (std::size_t i = 0; i < threads; ++i) {
+      workers.emplace_back([this] { work(); });
+    }
+  }
+
+  ~thread_pool() {
+    {
+      std::lock_guard<std::mutex> lock{mutex};
+      stopping = true;
+    }
+    ready.notify_all();
+    for (auto &worker : workers) {
+      worker.join();
+    }
+  }
+
+  thread_pool(thread_pool const &) = delete;
+  thread_pool &operator=(thread_pool const &) = delete;
+
+  void execute(std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> lock{mutex};
+      tasks.push_back(std::move(task));
+    }
+    ready.notify_one();
+  }
+
+  std::size_t size() const noexcept { return workers.size(); }
+
+private:
+  void work() {
+    for (;;) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock{mutex};
+        ready.wait(lock, [this] { return stopping || !tasks.empty(); });
+        if (tasks.empty()) {
+          return;
+        }
+        task = std::move(tasks.front());
+        tasks.pop_front();
+      }
+      task();
+    }
+  }
+
+  std::mutex mutex;
+  std::condition_variable ready;
+  std::deque<std::function<void()>> tasks;
+  bool stopping = false;
+  std::vector<std::thread> workers;
+};
+
+namespace detail {
+
+// One miss of an async cache: the promise its future reads from, and the
+// callbacks waiting for it to be fulfilled. Coroutines wait through these;
+// the type is the same with or without coroutine support so that C++17 and
+// C++20 translation units agree on the cache layout.
+template <typename R> class async_flight {
+public:
+  std::promise<R> promise;
+
+  // Queues `continuation` to run on the thread that fulfils the promise and
+  // returns true, or returns false if the promise is fulfilled already
+  bool then(std::function<void()> continuation) {
+    std::lock_guard<std::mutex> lock{mutex};
+    if (done) {
+      return false;
+    }
+    continuations.push_back(std::move(continuation));
+    return true;
+  }
+
+  // After the promise is fulfilled
+  void finish() {
+    std::vector<std::function<void()>> waiting;
+    {
+      std::lock_guard<std::mutex> lock{mutex};
+      done = true;
+      waiting.swap(continuations);
+    }
+    for (auto &continuation : waiting) {
+      continuation();
+    }
+  }
+
+private:
+  std::mutex mutex;
+  bool done = false;
+  std::vector<std::function<void()>> continuations;
+};
+
+} // namespace detail
+
+template <typename Signature, typename... Options> class BasicAsyncCache;
+
+// Memoizer whose misses run on an executor: a call returns a
+// std::shared_future<R> at once, hit or miss. A miss caches its future before
+// `func` starts, so later calls for the same key share it instead of
+// computing again; if `func` throws, the entry is dropped before the future
+// receives the exception, and the next call computes anew. Thread-safe: one
+// mutex guards the cache, and `func` runs outside it, on as many executor
+// threads at once as the executor has. Accepts the eviction policy options of
+// BasicCache. The destructor waits for the misses still running.
+//
+// An Executor takes a task and runs it, typically on another thread, e.g.
+// [&pool](auto task) { pool.execute(std::move(task)); }; a cache can also be
+// given a thread_pool directly.
+template <typename R, typename... Args, typename... Options> class BasicAsyncCache<R(Args...), Options...> {
+  using Flight = detail::async_flight<R>;
+
+  // What the cache holds for a key: its result, and the miss producing it
+  struct Pending {
+    std::shared_future<R> result;
+    std::shared_ptr<Flight> flight;
+  };
+
+  using EntryCache = BasicCache<Pending(Args...), callable<detail::no_function>, Options...>;
+  static_assert(!detail::has_option_v<traced, Options...>, "lru::traced needs a single-threaded BasicCache");
+  static_assert(!detail::has_option_v<fingerprinted, Options...>,
+                "lru::AsyncCache does not support lru::fingerprinted");
+
+public:
+  using Function =
+      typename detail::select_option_t<detail::callable_option, callable<std::function<R(Args...)>>, Options...>::type;
+  using Executor = std::function<void(std::function<void()>)>;
+  using Key = typename EntryCache::Key;
+  using Policy = typename EntryCache::Policy;
+  using MapHash = typename EntryCache::MapHash;
+
+  BasicAsyncCache(Function func, Executor executor, std::size_t capacity = 1024)
+      : func{std::move(func)}, executor{std::move(executor)}, cache{{}, capacity} {}
+
+  // Runs misses on `pool`, which must outlive the cache
+  BasicAsyncCache(Function func, thread_pool &pool, std::size_t capacity = 1024)
+      : BasicAsyncCache(
+            std::move(func), [&pool](std::function<void()> task) { pool.execute(std::move(task)); }, capacity) {}
+
+  ~BasicAsyncCache() {
+    std::unique_lock<std::mutex> lock{mutex};
+    idle.wait(lock, [this] { return running == 0; });
+  }
+
+  BasicAsyncCache(BasicAsyncCache const &) = delete;
+  BasicAsyncCache &operator=(BasicAsyncCache const &) = delete;
+
+  std::shared_future<R> operator()(Args... args) { return lookup(args...).result; }
+
+  std::size_t capacity() {
+    std::lock_guard<std::mutex> lock{mutex};
+    return cache.capacity();
+  }
+
+  // See BasicCache::resize and clear. Misses still running fulfil the
+  // futures already handed out; once their entry is dropped, the next call
+  // for the key computes again.
+  void resize(const std::size_t capacity) {
+    std::lock_guard<std::mutex> lock{mutex};
+    cache.resize(capacity);
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock{mutex};
+    cache.clear();
+  }
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+  // Waits for the value in a coroutine: `co_await cache.async(args...)`
+  // resumes on the thread that computed the value (at once on a hit) and
+  // returns a reference to it, or throws what `func` threw. The reference
+  // lives until the end of the co_await expression.
+  class awaiter {
+  public:
+    bool await_ready() const { return pending.result.wait_for(std::chrono::seconds{0}) == std::future_status::ready; }
+    bool await_suspend(std::coroutine_handle<> coroutine) {
+      return pending.flight->then([coroutine] { coroutine.resume(); });
+    }
+    R const &await_resume() const { return pending.result.get(); }
+
+  private:
+    friend class BasicAsyncCache;
+    explicit awaiter(Pending pending) : pending{std::move(pending)} {}
+    Pending pending;
+  };
+
+  awaiter async(Args... args) { return awaiter{lookup(args...)}; }
+#endif
+
+private:
+  // The cached entry for the arguments, or a new one whose miss is
+  // submitted to the executor
+  Pending lookup(Args &...args) {
+    const std::tuple<std::decay_t<Args> const &...> probe{args...};
+    const auto hash = MapHash{}(probe);
+    Pending pending;
+    {
+      std::lock_guard<std::mutex> lock{mutex};
+      if (const auto *hit = cache.find(probe, hash)) {
+        return *hit;
+      }
+      pending.flight = std::make_shared<Flight>();
+      pending.result = pending.flight->promise.get_future().share();
+      cache.insert(Key{args...}, hash, Pending{pending});
+      ++running;
+    }
+
+    try {
+      executor([this, key = Key{args...}, hash, flight = pending.flight]() mutable { run(key, hash, flight); });
+    } catch (...) {
+      fail(Key{args...}, hash, *pending.flight);
+      pending.flight->finish();
+      done();
+      throw;
+    }
+    return pending;
+  }
+
+  // The task of a miss, on an executor thread
+  void run(Key &key, const std::size_t hash, std::shared_ptr<Flight> const &flight) {
+    try {
+      flight->promise.set_value(std::apply(func, key));
+    } catch (...) {
+      fail(key, hash, *flight);
+    }
+    flight->finish();
+    done();
+  }
+
+  // Uncaches the entry of a failed miss, unless it was evicted and replaced
+  // since, then hands the exception to the callers waiting on it
+  void fail(Key const &key, const std::size_t hash, Flight &flight) {
+    {
+      std::lock_guard<std::mutex> lock{mutex};
+      if (const auto *entry = cache.find(key, hash); entry && entry->flight.get() == &flight) {
+        cache.erase(key, hash);
+      }
+    }
+    flight.promise.set_exception(std::current_exception());
+  }
+
+  void done() {
+    std::lock_guard<std::mutex> lock{mutex};
+    if (--running == 0) {
+      idle.notify_all();
+    }
+  }
+
+  const Function func;
+  const Executor executor;
+  std::mutex mutex;
+  std::condition_variable idle;
+  // Misses submitted and not finished yet
+  std::size_t running = 0;
+  EntryCache cache;
+};
+
+// The default async cache: strict LRU eviction
+template <typename R, typename... Args> using AsyncCache = BasicAsyncCache<R(Args...)>;
+
+// `Options` are forwarded to BasicAsyncCache and `f` is stored by value, like
+// make_cache. `executor` is an Executor or a thread_pool.
+template <typename... Options, typename F, typename E>
+auto make_async_cache(F &&f, E &&executor, std::size_t capacity = 1024) {
+  using Signature = typename detail::function_traits<std::decay_t<F>>::signature;
+  return BasicAsyncCache<Signature, callable<std::decay_t<F>>, Options...>(std::forward<F>(f),
+                                                                            std::forward<E>(executor), capacity);
+}
+
+} // namespace lru
@@ -0,0 +1,376 @@
+#pragma once
+
+#include "lru.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace lru {
+
+namespace detail {
+
+// Picks the shard from bits the per-shard index does not use: the index
+// homes a key with the top bits of a Fibonacci product, so the shard is taken
+// from a differently mixed hash to keep every shard's table evenly filled.
+constexpr std::size_t shard_of(const std::size_t hash, const std::size_t mask) noexcept {
+  auto h = static_cast<std::uint64_t>(hash);
+  h ^= h >> 33;
+  h *= 0xFF51AFD7ED558CCDULL;
+  h ^= h >> 33;
+  return static_cast<std::size_t>(h) & mask;
+}
+
+// A few shards per core keeps the odds of two threads meeting on a lock low
+inline std::size_t default_shards() noexcept {
+  return ceil_pow2(4 * std::max(1u, std::thread::hardware_concurrency()));
+}
+
+// Most shards a weighted cache is split into: every shard has a part of the
+// weight budget, and entries heavier than their shard's part are not cached
+inline constexpr std::size_t max_weighted_shards = 8;
+
+} // namespace detail
+
+// ConcurrentCache option: coalesce concurrent misses on the same key. The
+// first caller computes the value while later callers wait for its result
+// instead of running `func` again. If `func` throws, every waiter receives the
+// exception and nothing is cached.
+struct single_flight {};
+
+template <typename Signature, typename... Options> class BasicConcurrentCache;
+
+// Thread-safe memoizer: keys are partitioned across independently locked
+// shards, each one a BasicCache with its own eviction order. `func` runs
+// outside the shard lock, so a slow miss never blocks hits on the same shard;
+// it is called through a const reference and must be safe to call from
+// several threads at once. With a `read_only_hits` policy
+// (lru::policy::clock) hits only take the shard lock in shared mode, so
+// readers of a shard proceed in parallel. Accepts the BasicCache options
+// plus lru::single_flight.
+template <typename R, typename... Args, typename... Options> class BasicConcurrentCache<R(Args...), Options...> {
+  // Shards only serve find/insert, they never call a function themselves
+  using ShardCache = BasicCache<R(Args...), callable<detail::no_function>, Options...>;
+  static_assert(!detail::has_option_v<traced, Options...>, "lru::traced needs a single-threaded BasicCache");
+
+public:
+  using Function =
+      typename detail::select_option_t<detail::callable_option, callable<std::function<R(Args...)>>, Options...>::type;
+  using Key = typename ShardCache::Key;
+  using Policy = typename ShardCache::Policy;
+  using MapHash = typename ShardCache::MapHash;
+  using Weigher = typename ShardCache::Weigher;
+  using Stats = typename ShardCache::Stats;
+
+  // Memory resources the shards take turns allocating their entries from,
+  // e.g. one lru::huge_page_resource per NUMA node; none means the default
+  // resource. They must outlive the cache.
+  using Resources = std::vector<std::pmr::memory_resource *>;
+
+  explicit BasicConcurrentCache(Function func, std::size_t capacity = 1024, std::size_t shards = detail::default_shards(),
+                                Resources const &resources = {})
+      : max_entries{capacity}, func{std::move(func)} {
+    shards = shard_count(shards);
+    const auto per_shard = (capacity + shards - 1) / shards;
+    for (std::size_t i = 0; i < shards; ++i) {
+      shard_list.push_back(std::make_unique<Shard>(per_shard, resource_of(resources, i)));
+    }
+  }
+
+  // Weighted cache, see BasicCache: each shard gets an even part of both
+  // `capacity` and `max_weight`. A shard only admits entries up to its part
+  // of `max_weight`, so there are at most detail::max_weighted_shards shards
+  // and never more than `max_weight`: every entry up to max_weight / 8
+  // (max_weight / shards for fewer shards) is cached.
+  BasicConcurrentCache(Function func, std::size_t capacity, Weigher weigher, std::size_t max_weight,
+                       std::size_t shards = detail::default_shards(), Resources const &resources = {})
+      : max_entries{capacity}, func{std::move(func)} {
+    auto limit = detail::max_weighted_shards;
+    while (limit > 1 && limit > max_weight) {
+      limit >>= 1;
+    }
+    shards = shard_count(std::min(shards, limit));
+    const auto per_shard = (capacity + shards - 1) / shards;
+    for (std::size_t i = 0; i < shards; ++i) {
+      shard_list.push_back(
+          std::make_unique<Shard>(per_shard, weigher, max_weight / shards, resource_of(resources, i)));
+    }
+  }
+
+  R operator()(Args... args) {
+    const std::tuple<std::decay_t<Args> const &...> arguments{args...};
+    decltype(auto) probe = ShardCache::lookup_key(arguments);
+    const auto hash = MapHash{}(probe);
+    auto &shard = *shard_list[detail::shard_of(hash, shard_mask)];
+
+    {
+      HitLock lock{shard.mutex};
+      if (const auto *hit = shard.cache.find(probe, hash)) {
+        count(shard.counters, &ShardCounters::hits);
+        return *hit;
+      }
+    }
+    Key key = ShardCache::owned_key(probe);
+    if constexpr (coalesce) {
+      return compute_once(shard, std::move(key), hash, args...);
+    } else {
+      count(shard.counters, &ShardCounters::misses);
+      // Compute outside the lock, a slow miss must not stall the shard
+      std::uint64_t nanos = 0;
+      R val = compute(nanos, args...);
+
+      std::lock_guard<Mutex> lock{shard.mutex};
+      record_latency(shard, nanos);
+      return shard.cache.insert(std::move(key), hash, std::move(val));
+    }
+  }
+
+  // Drops the entry for the arguments under its shard lock; returns whether
+  // there was one. A miss computing meanwhile may still land afterwards.
+  bool erase(Args... args) {
+    const std::tuple<std::decay_t<Args> const &...> arguments{args...};
+    decltype(auto) probe = ShardCache::lookup_key(arguments);
+    const auto hash = MapHash{}(probe);
+    auto &shard = *shard_list[detail::shard_of(hash, shard_mask)];
+    std::lock_guard<Mutex> lock{shard.mutex};
+    return shard.cache.erase(probe, hash);
+  }
+
+  std::size_t shards() const noexcept { return shard_list.size(); }
+
+  std::size_t capacity() const noexcept { return max_entries.load(std::memory_order_relaxed); }
+
+  // Resizes every shard to an even part of `capacity` (at least one entry),
+  // one shard lock at a time, see BasicCache::resize. The number of shards
+  // does not change.
+  void resize(const std::size_t capacity) {
+    const auto per_shard = (capacity + shard_list.size() - 1) / shard_list.size();
+    for (auto &shard : shard_list) {
+      std::lock_guard<Mutex> lock{shard->mutex};
+      shard->cache.resize(per_shard);
+    }
+    max_entries.store(capacity, std::memory_order_relaxed);
+  }
+
+  // Empties every shard in O(1), one shard lock at a time, see
+  // BasicCache::clear. Misses computing meanwhile may still land.
+  void clear() {
+    for (auto &shard : shard_list) {
+      std::lock_guard<Mutex> lock{shard->mutex};
+      shard->cache.clear();
+    }
+  }
+
+  // With lru::expiring: a duration or a per-entry function, see
+  // BasicCache::expire_after
+  template <typename TimeToLive> void expire_after(const TimeToLive &time_to_live) {
+    for (auto &shard : shard_list) {
+      std::lock_guard<Mutex> lock{shard->mutex};
+      shard->cache.expire_after(time_to_live);
+    }
+  }
+
+  void evict_expired() {
+    for (auto &shard : shard_list) {
+      std::lock_guard<Mutex> lock{shard->mutex};
+      shard->cache.evict_expired();
+    }
+  }
+
+  // Sum of the shard weights, each read under its shard lock
+  std::size_t weight() const {
+    std::size_t total = 0;
+    for (const auto &shard : shard_list) {
+      std::lock_guard<Mutex> lock{shard->mutex};
+      total += shard->cache.weight();
+    }
+    return total;
+  }
+
+  // With lru::instrumented: the stats of every shard, each read under its
+  // shard lock, added up
+  cache_stats stats() const {
+    static_assert(instrumented, "stats needs the lru::instrumented option");
+    cache_stats total;
+    total.memory_bytes = sizeof(*this) + shard_list.size() * (sizeof(Shard) - sizeof(ShardCache));
+    for (const auto &shard : shard_list) {
+      std::lock_guard<Mutex> lock{shard->mutex};
+      auto snapshot = shard->cache.stats();
+      snapshot.hits = shard->counters.hits.load(std::memory_order_relaxed);
+      snapshot.misses = shard->counters.misses.load(std::memory_order_relaxed);
+      snapshot.miss_latency = shard->counters.miss_latency;
+      total += snapshot;
+    }
+    return total;
+  }
+
+private:
+  static constexpr bool coalesce = detail::has_option_v<single_flight, Options...>;
+  static constexpr bool instrumented = Stats::enabled;
+
+  using Mutex = std::conditional_t<Policy::read_only_hits, std::shared_mutex, std::mutex>;
+  using HitLock = std::conditional_t<Policy::read_only_hits, std::shared_lock<Mutex>, std::lock_guard<Mutex>>;
+  // Misses being computed, by key
+  using InFlight = std::unordered_map<Key, std::shared_future<R>, MapHash>;
+
+  // Shard caches only see find and insert, so hits, misses and miss latency
+  // are kept here. The counters are relaxed atomics next to the shard lock,
+  // whose cache line every lookup writes anyway, and the histogram is only
+  // written under the exclusive lock.
+  struct ShardCounters {
+    std::atomic<std::uint64_t> hits{0};
+    std::atomic<std::uint64_t> misses{0};
+    latency_histogram miss_latency;
+  };
+
+  // Each shard on its own cache lines so neighbouring locks do not false-share
+  struct alignas(64) Shard {
+    Shard(const std::size_t capacity, std::pmr::memory_resource *resource) : cache{{}, capacity, resource} {}
+    Shard(const std::size_t capacity, const Weigher &weigher, const std::size_t max_weight,
+          std::pmr::memory_resource *resource)
+        : cache{{}, capacity, weigher, max_weight, resource} {}
+
+    mutable Mutex mutex;
+    std::conditional_t<instrumented, ShardCounters, std::tuple<>> counters;
+    ShardCache cache;
+    std::conditional_t<coalesce, InFlight, std::tuple<>> in_flight;
+  };
+
+  static std::pmr::memory_resource *resource_of(Resources const &resources, const std::size_t shard) {
+    return resources.empty() ? std::pmr::get_default_resource() : resources[shard % resources.size()];
+  }
+
+  template <typename Counters, typename Counter>
+  static void count([[maybe_unused]] Counters &counters, [[maybe_unused]] Counter counter) noexcept {
+    if constexpr (instrumented) {
+      (counters.*counter).fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  // Runs `func` for a miss, timing it into `nanos` when instrumented
+  R compute([[maybe_unused]] std::uint64_t &nanos, Args &...args) const {
+    if constexpr (instrumented) {
+      const auto start = Stats::clock::now();
+      R val = func(std::forward<Args>(args)...);
+      const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Stats::clock::now() - start);
+      nanos = static_cast<std::uint64_t>(std::max<std::int64_t>(elapsed.count(), 0));
+      return val;
+    } else {
+      return func(std::forward<Args>(args)...);
+    }
+  }
+
+  // Under the exclusive shard lock
+  static void record_latency([[maybe_unused]] Shard &shard, [[maybe_unused]] const std::uint64_t nanos) noexcept {
+    if constexpr (instrumented) {
+      shard.counters.miss_latency.record(nanos);
+    }
+  }
+
+  // Power-of-two shard count, never more shards than entries
+  std::size_t shard_count(std::size_t shards) noexcept {
+    shards = detail::ceil_pow2(shards);
+    while (shards > 1 && shards > capacity()) {
+      shards >>= 1;
+    }
+    shard_mask = shards - 1;
+    return shards;
+  }
+
+  // Single-flight miss: either become the leader that runs `func` for `key`,
+  // or wait for the leader already running it
+  R compute_once(Shard &shard, Key &&key, const std::size_t hash, Args &...args) {
+    std::promise<R> promise;
+    std::shared_future<R> leader_result;
+    {
+      std::lock_guard<Mutex> lock{shard.mutex};
+      // The value may have landed while the shared lock was released
+      if (const auto *hit = shard.cache.find(key, hash)) {
+        count(shard.counters, &ShardCounters::hits);
+        return *hit;
+      }
+      // Waiters count as misses too, though only the leader's time is sampled
+      count(shard.counters, &ShardCounters::misses);
+      const auto [pending, leader] = shard.in_flight.try_emplace(key);
+      if (leader) {
+        pending->second = promise.get_future().share();
+      } else {
+        leader_result = pending->second;
+      }
+    }
+    if (leader_result.valid()) {
+      // Rethrows the leader's exception
+      return leader_result.get();
+    }
+
+    // Whether the marker for `key` is still in in_flight: once it is erased,
+    // `key` is moved into the cache and may no longer name it, while another
+    // leader may have registered the same key again
+    bool registered = true;
+    try {
+      std::uint64_t nanos = 0;
+      R val = compute(nanos, args...);
+      {
+        std::lock_guard<Mutex> lock{shard.mutex};
+        record_latency(shard, nanos);
+        shard.in_flight.erase(key);
+        registered = false;
+        // The weigher, time-to-live or copy of R may throw
+        shard.cache.insert(std::move(key), hash, R{val});
+      }
+      promise.set_value(val);
+      return val;
+    } catch (...) {
+      if (registered) {
+        std::lock_guard<Mutex> lock{shard.mutex};
+        shard.in_flight.erase(key);
+      }
+      promise.set_exception(std::current_exception());
+      throw;
+    }
+  }
+
+  std::atomic<std::size_t> max_entries;
+  const Function func;
+  std::size_t shard_mask;
+  std::vector<std::unique_ptr<Shard>> shard_list;
+};
+
+// The default thread-safe cache: strict LRU per shard
+template <typename R, typename... Args> using ConcurrentCache = BasicConcurrentCache<R(Args...)>;
+
+// `Options` are forwarded to BasicConcurrentCache and `f` is stored by value,
+// like make_cache
+template <typename... Options, typename F>
+auto make_concurrent_cache(F &&f, std::size_t capacity = 1024, std::size_t shards = detail::default_shards(),
+                           std::vector<std::pmr::memory_resource *> const &resources = {}) {
+  using Signature = typename detail::function_traits<std::decay_t<F>>::signature;
+  return BasicConcurrentCache<Signature, callable<std::decay_t<F>>, Options...>(std::forward<F>(f), capacity, shards,
+                                                                                 resources);
+}
+
+template <typename... Options, typename F, typename W>
+auto make_concurrent_cache(F &&f, std::size_t capacity, W &&weigher, std::size_t max_weight,
+                           std::size_t shards = detail::default_shards(),
+                           std::vector<std::pmr::memory_resource *> const &resources = {}) {
+  using Signature = typename detail::function_traits<std::decay_t<F>>::signature;
+  return BasicConcurrentCache<Signature, callable<std::decay_t<F>>, Options...>(
+      std::forward<F>(f), capacity, std::forward<W>(weigher), max_weight, shards, resources);
+}
+
+} // namespace lru
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "policy.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+
+namespace lru {
+
+namespace detail {
+
+// Tag base of the expiry options, see select_option
+struct expiry_option {};
+
+// Default expiry option: entries never expire
+struct no_expiry : expiry_option {
+  static constexpr bool enabled = false;
+  using clock = std::chrono::steady_clock;
+};
+
+inline constexpr std::int64_t never = std::numeric_limits<std::int64_t>::max();
+
+// Hierarchical timer wheel over slot indices, with deadlines in nanoseconds.
+// Each level is a ring of 64 buckets, every bucket spanning 64 times more
+// time than one of the level below (about 1ms, 67ms, 4s, 5min and 5h), and a
+// timer goes to the finest level whose ring still reaches its deadline.
+// Advancing the wheel visits only the buckets whose time has passed; a timer
+// found there either expires or drops to a finer level, so each one is
+// touched a bounded number of times. Deadlines past the coarsest ring wait
+// in its last bucket and are rescheduled from there.
+class timer_wheel {
+public:
+  timer_wheel(const std::size_t capacity, const std::int64_t now,
+              std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : timers{capacity, resource}, current{now} {
+    for (std::size_t i = 0; i < capacity; ++i) {
+      timers[i].bucket = npos;
+    }
+  }
+
+  std::int64_t deadline(const std::uint32_t slot) const noexcept { return timers[slot].deadline; }
+
+  // Bytes held for `capacity` timers
+  static std::size_t memory(const std::size_t capacity) noexcept {
+    return sizeof(timer_wheel) + capacity * sizeof(timer);
+  }
+
+  // Arms the timer of `slot`, which must not be armed; `never` leaves it off
+  // the wheel
+  void schedule(const std::uint32_t slot, const std::int64_t deadline) noexcept {
+    auto &timer = timers[slot];
+    timer.deadline = deadline;
+    if (deadline == never) {
+      timer.bucket = npos;
+      return;
+    }
+    timer.bucket = bucket_of(deadline);
+    wheel[timer.bucket].push_front(links(), slot);
+  }
+
+  void cancel(const std::uint32_t slot) noexcept {
+    auto &timer = timers[slot];
+    if (timer.bucket != npos) {
+      wheel[timer.bucket].erase(links(), slot);
+      timer.bucket = npos;
+    }
+  }
+
+  // Moves the wheel to `now`, calling `expire(slot)` for every timer due in
+  // the buckets passed over. `expire` must cancel the timer.
+  template <typename F> void advance(const std::int64_t now, F &&expire) {
+    const auto previous = current;
+    if (now <= previous) {
+      return;
+    }
+    current = now;
+    for (unsigned level = 0; level < levels; ++level) {
+      const auto previous_ticks = previous >> shifts[level];
+      const auto ticks = now >> shifts[level];
+      if (ticks == previous_ticks) {
+        break;
+      }
+      // Every bucket from the previous position to the current one, at most
+      // the whole ring
+      const auto steps = std::min<std::int64_t>(ticks - previous_ticks + 1, buckets);
+      for (std::int64_t step = 0; step < steps; ++step) {
+        auto &bucket = wheel[level * buckets + ((previous_ticks + step) & (buckets - 1))];
+        // Rescheduled timers may land in this bucket again, at its front
+        for (auto pending = bucket.size(); pending > 0; --pending) {
+          const auto slot = bucket.back();
+          if (timers[slot].deadline <= now) {
+            expire(slot);
+          } else {
+            bucket.erase(links(), slot);
+            schedule(slot, timers[slot].deadline);
+          }
+        }
+      }
+    }
+  }
+
+private:
+  static constexpr unsigned levels = 5;
+  static constexpr std::int64_t buckets = 64;
+  static constexpr unsigned shifts[levels] = {20, 26, 32, 38, 44};
+
+  struct timer : slot_links {
+    std::int64_t deadline;
+    std::uint32_t bucket;
+  };
+
+  // The accessor slot_list expects, over the timers
+  struct links_of {
+    timer *timers;
+    slot_links &operator()(const std::uint32_t slot) const noexcept { return timers[slot]; }
+  };
+
+  links_of links() const noexcept { return {timers.get()}; }
+
+  std::uint32_t bucket_of(const std::int64_t deadline) const noexcept {
+    // Past deadlines go to the current bucket, which the next advance visits
+    // first, rather than to one the ring has already passed
+    const auto due = std::max(deadline, current);
+    const auto delay = due - current;
+    for (unsigned level = 0; level < levels; ++level) {
+      if (delay < (buckets << shifts[level])) {
+        return level * buckets + static_cast<std::uint32_t>((due >> shifts[level]) & (buckets - 1));
+      }
+    }
+    // Beyond the coarsest ring: park in its furthest bucket
+    constexpr auto last = levels - 1;
+    const auto parked = current + ((buckets - 1) << shifts[last]);
+    return last * buckets + static_cast<std::uint32_t>((parked >> shifts[last]) & (buckets - 1));
+  }
+
+  const buffer<timer> timers;
+  slot_list wheel[levels * buckets];
+  std::int64_t current;
+};
+
+} // namespace detail
+
+// Cache option: entries expire a time-to-live after they were cached, see
+// BasicCache::expire_after. Expired entries are never returned; they are
+// dropped when looked up, and a timer wheel reclaims the others on misses.
+// `Clock` provides the time through a static now(), like the std::chrono
+// clocks; tests can substitute a manually advanced one.
+template <typename Clock = std::chrono::steady_clock> struct expiring : detail::expiry_option {
+  static constexpr bool enabled = true;
+  using clock = Clock;
+};
+
+} // namespace lru
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+namespace lru {
+
+namespace detail {
+
+// Bytes of a floating point T that hold its value: all of them, except for
+// the x87 80-bit format of long double on x86, padded to 12 or 16 bytes
+template <typename T>
+inline constexpr std::size_t value_bytes_v = std::numeric_limits<T>::digits == 64 ? 10 : sizeof(T);
+
+// Whether the bytes of a T identify its value, so keys of such types can be
+// hashed and compared as bytes. Floating point values without padding are
+// included: keys compare their bits (see BasicCache), which tell -0.0 from
+// 0.0 as a memoized function may well do too.
+template <typename T>
+inline constexpr bool bytewise_v =
+    std::is_trivially_copyable_v<T> && (std::has_unique_object_representations_v<T> ||
+                                        (std::is_floating_point_v<T> && value_bytes_v<T> == sizeof(T)));
+
+// 64x64 -> 128 bit multiply, folded back to 64 bits
+inline std::uint64_t mix(const std::uint64_t a, const std::uint64_t b) noexcept {
+#if defined(__SIZEOF_INT128__)
+  const auto product = static_cast<unsigned __int128>(a) * b;
+  return static_cast<std::uint64_t>(product) ^ static_cast<std::uint64_t>(product >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+  std::uint64_t high;
+  const auto low = _umul128(a, b, &high);
+  return low ^ high;
+#else
+  const std::uint64_t a_lo = a & 0xFFFFFFFFu, a_hi = a >> 32, b_lo = b & 0xFFFFFFFFu, b_hi = b >> 32;
+  const auto lo_lo = a_lo * b_lo, hi_lo = a_hi * b_lo, lo_hi = a_lo * b_hi, hi_hi = a_hi * b_hi;
+  const auto cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFFu) + lo_hi;
+  const auto high = hi_hi + (hi_lo >> 32) + (cross >> 32);
+  const auto low = (cross << 32) | (lo_lo & 0xFFFFFFFFu);
+  return low ^ high;
+#endif
+}
+
+// Hash in the style of wyhash over the bytes of a sequence of values, back
+// to back without padding: 16 bytes per 128-bit multiply. Values are shifted
+// into two 64-bit words in registers rather than copied into a buffer, so
+// small keys never round-trip through memory; with the sizes known at
+// compile time the bookkeeping folds away. Each `Lane` has secrets of its
+// own, see fingerprint_hasher.
+template <std::size_t Lane> class basic_byte_hasher {
+public:
+  explicit basic_byte_hasher(const std::size_t length) noexcept : length{length}, seed{secret[0] ^ length} {}
+
+  template <typename T> void add(T const &value) noexcept {
+    const auto *bytes = reinterpret_cast<const unsigned char *>(&value);
+    for (std::size_t offset = 0; offset < sizeof(T); offset += 8) {
+      constexpr std::size_t whole = sizeof(T) / 8 * 8;
+      const std::size_t size = offset < whole ? 8 : sizeof(T) - whole;
+      std::uint64_t bits = 0;
+      std::memcpy(&bits, bytes + offset, size);
+      append(bits, size);
+    }
+  }
+
+  // Same for `size` bytes known at run time, e.g. the contents of a string
+  void add_bytes(const void *data, const std::size_t size) noexcept {
+    const auto *bytes = static_cast<const unsigned char *>(data);
+    for (std::size_t offset = 0; offset < size; offset += 8) {
+      const std::size_t chunk = size - offset < 8 ? size - offset : 8;
+      std::uint64_t bits = 0;
+      std::memcpy(&bits, bytes + offset, chunk);
+      append(bits, chunk);
+    }
+  }
+
+  std::uint64_t finish() const noexcept {
+    return mix(secret[2] ^ length, mix(words[0] ^ secret[1], words[1] ^ seed));
+  }
+
+private:
+  static_assert(Lane < 2, "byte hashers have two lanes");
+  static constexpr std::uint64_t secrets[2][3] = {
+      {0xA0761D6478BD642FULL, 0xE7037ED1A0B428DBULL, 0x8EBC6AF09C88C6E3ULL},
+      {0x2D358DCCAA6C78A5ULL, 0x8BB84B93962EACC9ULL, 0x4B33A62ED433D4A3ULL}};
+  static constexpr std::uint64_t const (&secret)[3] = secrets[Lane];
+
+  // Appends the low `size` bytes of `bits` to the current 16-byte block
+  void append(const std::uint64_t bits, const std::size_t size) noexcept {
+    const auto word = fill / 8;
+    const auto shift = (fill % 8) * 8;
+    std::uint64_t carry = 0;
+    words[word] |= bits << shift;
+    if (shift != 0 && shift + size * 8 > 64) {
+      (word == 0 ? words[1] : carry) |= bits >> (64 - shift);
+    }
+    fill += size;
+    if (fill >= 16) {
+      seed = mix(words[0] ^ secret[1], words[1] ^ seed);
+      words[0] = carry;
+      words[1] = 0;
+      fill -= 16;
+    }
+  }
+
+  const std::size_t length;
+  std::uint64_t seed;
+  std::uint64_t words[2] = {0, 0};
+  std::size_t fill = 0;
+};
+
+using byte_hasher = basic_byte_hasher<0>;
+
+} // namespace detail
+
+// 128-bit hash of a cache's arguments, which lru::fingerprinted stores in
+// place of them
+struct fingerprint {
+  std::uint64_t low;
+  std::uint64_t high;
+
+  friend bool operator==(fingerprint const &a, fingerprint const &b) noexcept {
+    return a.low == b.low && a.high == b.high;
+  }
+  friend bool operator!=(fingerprint const &a, fingerprint const &b) noexcept { return !(a == b); }
+};
+
+namespace detail {
+
+// Both byte_hasher lanes over the same bytes, one half of the fingerprint
+// each. Their secrets differ, so a block that zeroes one lane's multiply
+// (the weak spot of wyhash) leaves the other lane's state intact.
+class fingerprint_hasher {
+public:
+  explicit fingerprint_hasher(const std::size_t length) noexcept : lane0{length}, lane1{length} {}
+
+  template <typename T> void add(T const &value) noexcept {
+    lane0.add(value);
+    lane1.add(value);
+  }
+
+  void add_bytes(const void *data, const std::size_t size) noexcept {
+    lane0.add_bytes(data, size);
+    lane1.add_bytes(data, size);
+  }
+
+  fingerprint finish() const noexcept { return {lane0.finish(), lane1.finish()}; }
+
+private:
+  basic_byte_hasher<0> lane0;
+  basic_byte_hasher<1> lane1;
+};
+
+} // namespace detail
+
+// Cache option: store a 128-bit fingerprint of the arguments as the key
+// instead of a copy of them, so an entry's size no longer depends on theirs
+// and a hit compares 16 bytes instead of the arguments. Arguments must be
+// trivially copyable, or strings or std::vectors of trivially copyable
+// elements, which are hashed as their length and contents.
+//
+// Two different argument tuples get the same fingerprint, and one returns
+// the other's value, with a probability of 2^-128 for inputs that were not
+// crafted to collide: among n distinct argument tuples ever looked up, at
+// most n^2 / 2^129 (below 10^-14 for n = 10^12). The hash is not
+// cryptographic, so arguments an attacker chooses should not be fingerprinted.
+struct fingerprinted {};
+
+} // namespace lru
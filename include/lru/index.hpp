@@ -0,0 +1,209 @@
+#pragma once
+
+#include "memory.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LRU_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace lru {
+
+namespace detail {
+
+inline constexpr std::uint32_t npos = std::numeric_limits<std::uint32_t>::max();
+
+// Rounds `n` up to a power of two (at least 1)
+constexpr std::size_t ceil_pow2(const std::size_t n) noexcept {
+  std::size_t pow2 = 1;
+  while (pow2 < n) {
+    pow2 <<= 1;
+  }
+  return pow2;
+}
+
+// Hints the CPU to start loading `address` into the cache
+inline void prefetch(const void *address) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_prefetch(address);
+#else
+  static_cast<void>(address);
+#endif
+}
+
+// Index of the lowest set bit of a non-zero mask
+inline unsigned lowest_bit(std::uint64_t mask) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<unsigned>(__builtin_ctzll(mask));
+#else
+  unsigned i = 0;
+  for (; !(mask & 1); mask >>= 1) {
+    ++i;
+  }
+  return i;
+#endif
+}
+
+// One cache line of a slot_index: 12 buckets, the control byte of each (a 7
+// bit tag of the hash of its slot, or `empty`) and how many slots were
+// inserted past the group because it was full. The control bytes are
+// compared all at once: with SSE2, one load and one compare per query, else
+// in a loop compilers vectorize. Bit i of a mask stands for bucket i.
+struct alignas(64) bucket_group {
+  static constexpr std::size_t width = 12;
+  static constexpr std::uint8_t empty = 0x80;
+  // Only the buckets' bits of a 16 byte compare
+  static constexpr std::uint32_t buckets_mask = (1u << width) - 1;
+
+  std::uint8_t control[16];
+  std::uint32_t slots[width];
+
+  bucket_group() noexcept {
+    std::fill_n(control, width, empty);
+    std::fill_n(control + width, sizeof(control) - width, std::uint8_t{0});
+    std::fill_n(slots, width, npos);
+  }
+
+  std::uint32_t match(const std::uint8_t tag) const noexcept {
+#ifdef LRU_SSE2
+    const auto bytes = _mm_load_si128(reinterpret_cast<const __m128i *>(control));
+    return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(static_cast<char>(tag))))) &
+           buckets_mask;
+#else
+    std::uint32_t mask = 0;
+    for (std::size_t i = 0; i < width; ++i) {
+      mask |= std::uint32_t{control[i] == tag} << i;
+    }
+    return mask;
+#endif
+  }
+
+  std::uint32_t match_empty() const noexcept { return match(empty); }
+
+  // Saturates: a group passed by 255 insertions stays overflowed
+  std::uint8_t &overflow() noexcept { return control[width]; }
+  std::uint8_t overflow() const noexcept { return control[width]; }
+};
+
+// Open-addressing table of slot indices. Keys are not stored here: the caller
+// resolves a candidate slot through its own slot array, so every key exists
+// exactly once.
+//
+// Buckets come in cache-line groups (see bucket_group) probed linearly from
+// the home group of a hash. A probe compares the tag of the hash with the
+// group's control bytes and only resolves the slots that match, so a hit
+// usually loads one group and one slot, and a miss no slot at all. Instead of
+// tombstones, each group counts the insertions that went past it: a probe
+// stops at the first group that has none, and an erase undoes the counts
+// along its probe, so evictions leave nothing behind.
+class slot_index {
+public:
+  // Keeps the load factor at or below 1/2
+  explicit slot_index(const std::size_t capacity,
+                      std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : shift{std::numeric_limits<std::uint64_t>::digits - log2_groups(capacity)},
+        mask{(std::size_t{1} << log2_groups(capacity)) - 1}, groups{mask + 1, resource} {}
+
+  // Returns the slot whose key satisfies `match`, or npos
+  template <typename Match> std::uint32_t find(const std::size_t hash, Match &&match) const {
+    const auto tag = tag_of(hash);
+    for (auto pos = home(hash);; pos = (pos + 1) & mask) {
+      auto const &group = groups[pos];
+      for (auto matches = group.match(tag); matches; matches &= matches - 1) {
+        const auto slot = group.slots[lowest_bit(matches)];
+        if (match(slot)) {
+          return slot;
+        }
+      }
+      if (group.overflow() == 0) {
+        return npos;
+      }
+    }
+  }
+
+  // Prefetches the home group of `hash`
+  void prefetch(const std::size_t hash) const noexcept { detail::prefetch(&groups[home(hash)]); }
+
+  // The first slot find will check for `hash` if it is in the home group, or
+  // npos
+  std::uint32_t first_candidate(const std::size_t hash) const noexcept {
+    auto const &group = groups[home(hash)];
+    const auto matches = group.match(tag_of(hash));
+    return matches ? group.slots[lowest_bit(matches)] : npos;
+  }
+
+  std::size_t memory() const noexcept { return (mask + 1) * sizeof(bucket_group); }
+
+  // `slot` must not be present yet
+  void insert(const std::size_t hash, const std::uint32_t slot) noexcept {
+    auto pos = home(hash);
+    auto empties = groups[pos].match_empty();
+    while (!empties) {
+      auto &overflow = groups[pos].overflow();
+      overflow += overflow != std::numeric_limits<std::uint8_t>::max();
+      pos = (pos + 1) & mask;
+      empties = groups[pos].match_empty();
+    }
+    auto &group = groups[pos];
+    const auto i = lowest_bit(empties);
+    group.control[i] = tag_of(hash);
+    group.slots[i] = slot;
+  }
+
+  // `slot` must have been inserted with `hash`
+  void erase(const std::size_t hash, const std::uint32_t slot) noexcept {
+    const auto tag = tag_of(hash);
+    for (auto pos = home(hash);; pos = (pos + 1) & mask) {
+      auto &group = groups[pos];
+      for (auto matches = group.match(tag); matches; matches &= matches - 1) {
+        const auto i = lowest_bit(matches);
+        if (group.slots[i] == slot) {
+          group.control[i] = bucket_group::empty;
+          group.slots[i] = npos;
+          return;
+        }
+      }
+      auto &overflow = group.overflow();
+      overflow -= overflow != std::numeric_limits<std::uint8_t>::max();
+    }
+  }
+
+private:
+  // At least two groups, so the tag bits sit below the group bits
+  static constexpr unsigned log2_groups(const std::size_t capacity) noexcept {
+    unsigned log2 = 1;
+    while ((std::size_t{1} << log2) * bucket_group::width < 2 * capacity) {
+      ++log2;
+    }
+    return log2;
+  }
+
+  // Fibonacci hashing: the identity std::hash of integers would cluster. The
+  // top bits of the product pick the home group, the 7 below them the tag.
+  static std::uint64_t spread(const std::size_t hash) noexcept {
+    return static_cast<std::uint64_t>(hash) * 0x9E3779B97F4A7C15ULL;
+  }
+
+  std::size_t home(const std::size_t hash) const noexcept {
+    return static_cast<std::size_t>(spread(hash) >> shift);
+  }
+
+  std::uint8_t tag_of(const std::size_t hash) const noexcept {
+    return static_cast<std::uint8_t>((spread(hash) >> (shift - 7)) & 0x7F);
+  }
+
+  unsigned shift;
+  std::size_t mask;
+  buffer<bucket_group> groups;
+};
+
+} // namespace detail
+
+} // namespace lru
@@ -1,11 +1,30 @@
 #pragma once
 
+#include "expiry.hpp"
+#include "hash.hpp"
+#include "index.hpp"
+#include "memory.hpp"
+#include "policy.hpp"
+#include "snapshot.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
 #include <boost/functional/hash.hpp>
-#include <emhash/hash_table7.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <functional>
+#include <istream>
 #include <limits>
-#include <list>
+#include <memory>
 #include <memory_resource>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
 #include <tuple>
 #include <type_traits>
 #include <utility>
@@ -18,110 +37,1119 @@ namespace detail {
 template <typename T>
 struct function_traits : function_traits<decltype(&T::operator())> {};
 
-template <typename F, std::size_t... I>
-auto make_cache_helper(F &&f, std::size_t capacity, std::index_sequence<I...>);
-
 template <typename R, typename... Args> struct function_traits<R (*)(Args...)> {
   using return_type = R;
   using argument_types = std::tuple<Args...>;
+  using signature = R(Args...);
 };
 
+template <typename R, typename... Args>
+struct function_traits<R (*)(Args...) noexcept> : function_traits<R (*)(Args...)> {};
+
+// Member functions, including a mutable operator(): the signature leaves out
+// the object they are called on
 template <typename ClassType, typename R, typename... Args>
-struct function_traits<R (ClassType::*)(Args...) const> {
-  using return_type = R;
-  using argument_types = std::tuple<Args...>;
+struct function_traits<R (ClassType::*)(Args...)> : function_traits<R (*)(Args...)> {};
+
+template <typename ClassType, typename R, typename... Args>
+struct function_traits<R (ClassType::*)(Args...) const> : function_traits<R (*)(Args...)> {};
+
+template <typename ClassType, typename R, typename... Args>
+struct function_traits<R (ClassType::*)(Args...) noexcept> : function_traits<R (*)(Args...)> {};
+
+template <typename ClassType, typename R, typename... Args>
+struct function_traits<R (ClassType::*)(Args...) const noexcept> : function_traits<R (*)(Args...)> {};
+
+// Tag base of lru::callable, see select_option
+struct callable_option {};
+
+// Calls the function (pointer) `Fn`, known at compile time, so the call
+// inlines and the cache stores nothing for it
+template <auto Fn> struct function_constant {
+  template <typename... Args> decltype(auto) operator()(Args &&...args) const {
+    return std::invoke(Fn, std::forward<Args>(args)...);
+  }
+};
+
+// Calls the member function `Fn` on an object the caller keeps alive
+template <auto Fn, typename ClassType> struct bound_member {
+  ClassType *object;
+
+  template <typename... Args> decltype(auto) operator()(Args &&...args) const {
+    return std::invoke(Fn, object, std::forward<Args>(args)...);
+  }
 };
 
+// Callable of caches that never call it, see BasicConcurrentCache
+struct no_function {};
+
 template <typename... Args> struct tuple_hash;
 template <typename... Args> struct tuple_hash<std::tuple<Args...>>;
+template <> struct tuple_hash<std::tuple<fingerprint>>;
+template <typename... Args> struct tuple_fingerprint;
+template <typename... Args> struct tuple_fingerprint<std::tuple<Args...>>;
+template <typename... Args> struct tuple_equal;
+template <typename... Args> struct tuple_equal<std::tuple<Args...>>;
+
+template <typename T> struct string_traits : std::false_type {
+  using view = void;
+};
+
+template <typename C, typename T, typename A> struct string_traits<std::basic_string<C, T, A>> : std::true_type {
+  using view = std::basic_string_view<C, T>;
+};
+
+// Whether T is a std::vector whose elements can be hashed as bytes
+template <typename T> inline constexpr bool byte_vector_v = false;
+template <typename T, typename A>
+inline constexpr bool byte_vector_v<std::vector<T, A>> = bytewise_v<T> && !std::is_same_v<T, bool>;
+
+// Whether the elements of a key are all flat (see snapshot.hpp), and their
+// total size
+template <typename Key> struct key_layout;
+template <typename... Ts> struct key_layout<std::tuple<Ts...>> {
+  static constexpr bool flat = (flat_v<Ts> && ...);
+  static constexpr std::size_t bytes = (sizeof(Ts) + ... + 0);
+};
+
+// Whether an argument of type T can be looked up as a view of the string key
+// element Elem, without building an Elem
+template <typename Elem, typename T>
+inline constexpr bool views_string_v = string_traits<Elem>::value && !std::is_same_v<std::decay_t<T>, Elem> &&
+                                       std::is_convertible_v<T const &, typename string_traits<Elem>::view>;
+
+// How a lookup holds an argument T for the key element Elem: by reference if
+// it already is an Elem, as a view of a string, or else converted to Elem
+template <typename Elem, typename T>
+using probe_element_t =
+    std::conditional_t<std::is_same_v<std::decay_t<T>, Elem>, Elem const &,
+                       std::conditional_t<views_string_v<Elem, T>, typename string_traits<Elem>::view, Elem>>;
+
+// Whether Ts... can be looked up against Key without building it: every
+// argument is an element, a view of one or converts to one, and at least one
+// string is viewed (other calls take the plain call operator)
+template <typename Key, typename Probe, typename = void> struct heterogeneous_call : std::false_type {};
+
+template <typename... Elems, typename... Ts>
+struct heterogeneous_call<std::tuple<Elems...>, std::tuple<Ts...>, std::enable_if_t<sizeof...(Elems) == sizeof...(Ts)>>
+    : std::bool_constant<((std::is_same_v<std::decay_t<Ts>, Elems> || views_string_v<Elems, Ts> ||
+                           std::is_convertible_v<Ts const &, Elems>)&&...) &&
+                         (views_string_v<Elems, Ts> || ...)> {};
 
 } // namespace detail
 
-template <typename R, typename... Args> class Cache {
+// Cache option: store the function as an `F`, called directly, instead of
+// the default std::function<R(Args...)>. make_cache picks it for the callable
+// it is given.
+template <typename F> struct callable : detail::callable_option {
+  using type = F;
+};
+
+template <typename Signature, typename... Options> class BasicCache;
+
+// Memoizes a function of signature R(Args...). `Options` select the eviction
+// policy (lru::policy::lru by default, see policy.hpp), whether entries
+// expire (lru::expiring, see expiry.hpp), whether it keeps statistics
+// (lru::instrumented, see stats.hpp) or a trace of its lookups (lru::traced,
+// see trace.hpp), whether keys are fingerprints of the arguments
+// (lru::fingerprinted, see hash.hpp) and how the function is stored
+// (lru::callable).
+//
+// Floating point arguments are keyed by their bits, whatever the other
+// arguments: -0.0 and 0.0 are different keys, and a NaN argument finds the
+// entry computed for the same NaN.
+//
+// `capacity` bounds the number of entries. A cache built with a weigher also
+// bounds their total weight (e.g. bytes): every entry weighs
+// weigher(key, value), and entries are evicted until a new one fits in
+// `max_weight`. Entries heavier than `max_weight` are returned but not cached.
+template <typename R, typename... Args, typename... Options>
+class BasicCache<R(Args...), Options...>
+    : private detail::stat_counters<detail::select_option_t<detail::stats_option, detail::no_stats, Options...>::enabled>,
+      private detail::trace_sink<detail::has_option_v<traced, Options...>> {
 public:
-  using Function = std::function<R(Args...)>;
-  using Key = std::tuple<std::decay_t<Args>...>;
+  using Function =
+      typename detail::select_option_t<detail::callable_option, callable<std::function<R(Args...)>>, Options...>::type;
+  using Arguments = std::tuple<std::decay_t<Args>...>;
+  // What entries are stored under: the arguments, or with lru::fingerprinted
+  // their fingerprint, which weighers, time-to-live functions and snapshot
+  // serializers then see instead
+  using Key =
+      std::conditional_t<detail::has_option_v<fingerprinted, Options...>, std::tuple<fingerprint>, Arguments>;
+  using Policy = detail::select_option_t<detail::eviction_option, policy::lru, Options...>;
+  using Weigher = std::function<std::size_t(Key const &, R const &)>;
+  using Expiry = detail::select_option_t<detail::expiry_option, detail::no_expiry, Options...>;
+  using Clock = typename Expiry::clock;
+  using Stats = detail::select_option_t<detail::stats_option, detail::no_stats, Options...>;
+  // Time-to-live of a new entry
+  using TimeToLive = std::function<typename Clock::duration(Key const &, R const &)>;
 
   // For simpler reference to the custom tuple-hash
   using MapHash = detail::tuple_hash<Key>;
-  const std::size_t capacity;
 
-  explicit Cache(Function func, std::size_t capacity = 1024)
-      : capacity{capacity}, func{std::move(func)}, buffer(capacity),
-        cache_map(capacity) {}
+  // The storage of the entries (slots, index, weights and timers) comes from
+  // `resource`, e.g. an lru::huge_page_resource, which must outlive the cache
+  explicit BasicCache(Function func, std::size_t capacity = 1024,
+                      std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : max_entries{checked_capacity(capacity)}, max_weight{capacity}, func{std::move(func)}, resource{resource},
+        slots{capacity, resource}, index{capacity, resource}, eviction{capacity} {
+    free_all_slots();
+    if constexpr (expires) {
+      wheel = std::make_unique<detail::timer_wheel>(capacity, now(), resource);
+    }
+  }
+
+  BasicCache(Function func, std::size_t capacity, Weigher weigher, std::size_t max_weight,
+             std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : BasicCache(std::move(func), capacity, resource) {
+    if (!weigher) {
+      throw std::invalid_argument("lru::Cache weigher must not be empty");
+    }
+    this->max_weight = max_weight;
+    this->weigher = std::move(weigher);
+    weights = detail::buffer<std::size_t>{capacity, resource};
+  }
+
+  BasicCache(const BasicCache &) = delete;
+  BasicCache &operator=(const BasicCache &) = delete;
+
+  ~BasicCache() {
+    eviction.for_each(meta_of(), [this](const std::uint32_t slot) { slots[slot].entry.~pair(); });
+  }
+
+  constexpr R operator()(Args... args) { return get(std::forward<Args>(args)...); }
+
+  // Heterogeneous call: string arguments may be passed as anything that
+  // converts to a string view (literals, std::string_view...), and a hit then
+  // never builds a std::string
+  template <typename... Ts,
+            typename = std::enable_if_t<detail::heterogeneous_call<Arguments, std::tuple<Ts...>>::value>>
+  R operator()(Ts const &...ts) {
+    return get(ts...);
+  }
+
+  // Like operator(), but returns the cached value itself, so a hit copies
+  // nothing and R may be move-only. The reference is valid until the next
+  // call on the cache, which may evict the entry.
+  R const &get(Args... args) {
+    // Hits only look at the arguments, the key is copied from them on a miss
+    const std::tuple<std::decay_t<Args> const &...> probe{args...};
+    return get_or_compute(probe,
+                          [&](auto const &key) { return Entry{owned_key(key), func(std::forward<Args>(args)...)}; });
+  }
+
+  template <typename... Ts,
+            typename = std::enable_if_t<detail::heterogeneous_call<Arguments, std::tuple<Ts...>>::value>>
+  R const &get(Ts const &...ts) {
+    const std::tuple<detail::probe_element_t<std::decay_t<Args>, Ts>...> probe{ts...};
+    return get_or_compute(probe, [&](auto const &key) {
+      Arguments arguments{std::decay_t<Args>(ts)...};
+      R val = std::apply(func, std::as_const(arguments));
+      if constexpr (fingerprinting) {
+        return Entry{key, std::move(val)};
+      } else {
+        return Entry{std::move(arguments), std::move(val)};
+      }
+    });
+  }
 
-  constexpr R operator()(Args... args) {
-    Key key{std::forward<Args>(args)...};
+  // Writes the value of every key in [first, last) to out[0, last - first)
+  // and returns the end of the output. Keys are Keys, or arguments of a
+  // one-argument function. Hits are software pipelined: a key's index bucket
+  // is prefetched 2 * ahead keys before it is resolved and its slot `ahead`
+  // keys before, so the memory accesses of neighbouring keys overlap. Misses
+  // are computed last: one by one through `func`, or all in one call to
+  // `batch(std::vector<Key> const &) -> std::vector<R>` returning their values
+  // in order. A key given more than once is computed once.
+  template <typename ForwardIt, typename RandomIt> RandomIt get_many(ForwardIt first, ForwardIt last, RandomIt out) {
+    return get_many(first, last, out, detail::no_function{});
+  }
+
+  template <typename ForwardIt, typename RandomIt, typename Batch>
+  RandomIt get_many(ForwardIt first, ForwardIt last, RandomIt out, Batch &&batch) {
+    static_assert(!fingerprinting, "get_many does not support lru::fingerprinted");
+    constexpr std::size_t ahead = 8;
+    // Hashes of the keys between the one resolved and the last one hashed
+    constexpr std::size_t window = 4 * ahead;
+    std::size_t hashes[window];
+    std::vector<Key> missed;
+    std::vector<std::pair<std::size_t, std::size_t>> missed_at; // (position, hash)
+
+    auto hashed = first;
+    std::size_t hashed_count = 0;
+    const auto hash_next = [&] {
+      if (hashed != last) {
+        const auto hash = MapHash{}(probe_of(*hashed));
+        index.prefetch(hash);
+        hashes[hashed_count++ % window] = hash;
+        ++hashed;
+      }
+    };
+    const auto prefetch_slot = [&](const std::size_t pos) {
+      if (pos < hashed_count) {
+        if (const auto candidate = index.first_candidate(hashes[pos % window]); candidate != npos) {
+          detail::prefetch(&slots[candidate]);
+        }
+      }
+    };
+
+    for (std::size_t i = 0; i < 2 * ahead; ++i) {
+      hash_next();
+    }
+    for (std::size_t i = 0; i < ahead; ++i) {
+      prefetch_slot(i);
+    }
+    std::size_t pos = 0;
+    for (auto key = first; key != last; ++key, ++pos) {
+      hash_next();
+      prefetch_slot(pos + ahead);
+      const auto hash = hashes[pos % window];
+      trace(hash);
+      if (const auto slot = lookup_live(probe_of(*key), hash); slot != npos) {
+        count(&Counters::hits);
+        eviction.on_hit(meta_of(), slot);
+        out[pos] = slots[slot].entry.second;
+      } else {
+        count(&Counters::misses);
+        missed.push_back(key_of(*key));
+        missed_at.emplace_back(pos, hash);
+      }
+    }
+
+    // A key missed more than once is computed once, for its first position,
+    // and copied to the others
+    const auto first_copy = first_copies(missed, missed_at);
+    if constexpr (std::is_same_v<std::decay_t<Batch>, detail::no_function>) {
+      for (std::size_t i = 0; i < missed.size(); ++i) {
+        if (first_copy[i] != i) {
+          out[missed_at[i].first] = out[missed_at[first_copy[i]].first];
+          continue;
+        }
+        R val = timed([&] { return std::apply(func, std::as_const(missed[i])); });
+        out[missed_at[i].first] = insert(std::move(missed[i]), missed_at[i].second, std::move(val));
+      }
+    } else if (!missed.empty()) {
+      std::vector<Key> distinct;
+      for (std::size_t i = 0; i < missed.size(); ++i) {
+        if (first_copy[i] == i) {
+          distinct.push_back(std::move(missed[i]));
+        }
+      }
+      auto values = timed([&] { return batch(std::as_const(distinct)); });
+      if (values.size() != distinct.size()) {
+        throw std::length_error("lru::Cache batch function must return one value per key");
+      }
+      for (std::size_t i = 0, next = 0; i < missed.size(); ++i) {
+        if (first_copy[i] != i) {
+          out[missed_at[i].first] = out[missed_at[first_copy[i]].first];
+        } else {
+          out[missed_at[i].first] = insert(std::move(distinct[next]), missed_at[i].second, std::move(values[next]));
+          ++next;
+        }
+      }
+    }
+    return out + pos;
+  }
+
+  // With lru::instrumented: the counters so far and the current occupancy
+  cache_stats stats() const {
+    static_assert(instrumented, "stats needs the lru::instrumented option");
+    cache_stats snapshot;
+    snapshot.hits = this->hits;
+    snapshot.misses = this->misses;
+    snapshot.inserts = this->inserts;
+    snapshot.erases = this->erases;
+    snapshot.evictions = this->evictions;
+    snapshot.expirations = this->expirations;
+    // Entries left by clear() are erased as they are reclaimed
+    snapshot.size = static_cast<std::size_t>(this->inserts - this->erases) - stale;
+    snapshot.capacity = max_entries;
+    snapshot.weight = weight();
+    snapshot.memory_bytes = sizeof(*this) + max_entries * sizeof(Slot) + index.memory() +
+                            (weights ? max_entries * sizeof(std::size_t) : 0) +
+                            (wheel ? detail::timer_wheel::memory(max_entries) : 0);
+    snapshot.miss_latency = this->miss_latency;
+    return snapshot;
+  }
+
+  // With lru::traced: appends the hash of every key looked up from now on to
+  // `writer`, which must outlive the recording; nullptr stops it
+  void record_to(trace_writer *writer) noexcept {
+    static_assert(tracing, "record_to needs the lru::traced option");
+    this->recorder = writer;
+  }
 
-    if (const auto it = cache_map.find(key); it != cache_map.end()) {
-      // Move to front => most recently used
-      cache_list.splice(cache_list.begin(), cache_list, it->second);
-      return cache_list.begin()->second;
+  // Writes the live entries to `path`, least recently used first, along with
+  // the capacity. Keys and values must be trivially copyable: each entry is
+  // stored as the raw bytes of its key fields and value, so load() copies
+  // records straight out of the memory-mapped file. The file is replaced
+  // only once complete.
+  void save(const std::string &path) const {
+    static_assert(flat_entries, "save(path) needs trivially copyable arguments and result, pass a serializer");
+    detail::snapshot_file file{path};
+    const auto entries = live_slots();
+    write_snapshot_header(file, true, entries.size());
+    for (auto slot = entries.rbegin(); slot != entries.rend(); ++slot) {
+      const auto &[key, val] = slots[*slot].entry;
+      std::apply([&](auto const &...field) { (file.write(&field, sizeof(field)), ...); }, key);
+      file.write(&val, sizeof(val));
     }
-    put(key, func(std::forward<Args>(args)...));
-    return cache_list.begin()->second;
+    file.commit();
+  }
+
+  // Same for any key and value: `write(std::ostream &, Key const &, R const &)`
+  // serializes an entry
+  template <typename Write> void save(const std::string &path, Write &&write) const {
+    detail::snapshot_file file{path};
+    const auto entries = live_slots();
+    write_snapshot_header(file, false, entries.size());
+    for (auto slot = entries.rbegin(); slot != entries.rend(); ++slot) {
+      write(file.stream(), slots[*slot].entry.first, std::as_const(slots[*slot].entry.second));
+    }
+    file.commit();
+  }
+
+  // Caches the entries of a snapshot written by save(path), oldest first, as
+  // if they had just been computed: the most recent ones are kept when the
+  // snapshot holds more than fit, keys already cached keep their value, and
+  // with lru::expiring every entry starts a new time-to-live. Throws
+  // std::runtime_error if the file is not a snapshot of these types.
+  void load(const std::string &path) {
+    static_assert(flat_entries, "load(path) needs trivially copyable arguments and result, pass a deserializer");
+    const detail::mapped_file file{path};
+    const auto header = detail::read_snapshot_header(file, true, key_bytes, sizeof(R));
+    const auto skip = header.count > max_entries ? header.count - max_entries : 0;
+    const char *record = file.data() + sizeof(header) + skip * (key_bytes + sizeof(R));
+    // Snapshot keys are distinct: an empty cache can skip looking them up
+    const bool fresh = occupied == stale;
+    for (auto i = skip; i < header.count; ++i) {
+      Key key;
+      std::apply([&](auto &...field) { ((std::memcpy(&field, record, sizeof(field)), record += sizeof(field)), ...); },
+                 key);
+      R val;
+      std::memcpy(&val, record, sizeof(val));
+      record += sizeof(val);
+      const auto hash = MapHash{}(key);
+      if (fresh) {
+        put(std::move(key), hash, val);
+      } else {
+        insert(std::move(key), hash, std::move(val));
+      }
+    }
+  }
+
+  // Same for a snapshot written with a serializer:
+  // `read(std::istream &) -> std::pair<Key, R>` deserializes an entry
+  template <typename Read> void load(const std::string &path, Read &&read) {
+    const detail::mapped_file file{path};
+    const auto header = detail::read_snapshot_header(file, false, 0, 0);
+    detail::snapshot_source records{file};
+    std::istream in{&records};
+    const auto skip = header.count > max_entries ? header.count - max_entries : 0;
+    for (std::uint64_t i = 0; i < header.count; ++i) {
+      auto entry = read(in);
+      if (!in) {
+        throw std::runtime_error("lru: truncated snapshot " + path);
+      }
+      if (i >= skip) {
+        const auto hash = MapHash{}(entry.first);
+        insert(std::move(entry.first), hash, std::move(entry.second));
+      }
+    }
+  }
+
+  // Total weight of the cached entries; their number without a weigher
+  std::size_t weight() const noexcept { return total_weight - stale_weight; }
+
+  std::size_t capacity() const noexcept { return max_entries; }
+
+  // Changes the capacity without recomputing the entries that stay: when
+  // shrinking, the policy's victims (the least recently used entries for
+  // strict LRU) are evicted first, as misses would. The rest move to storage
+  // of the new size with their weight and expiry, and are inserted again in
+  // the policy's order, so strict LRU keeps its exact order while the other
+  // policies forget their hit bits and frequencies. O(entries + capacity).
+  void resize(const std::size_t capacity) {
+    checked_capacity(capacity);
+    while (occupied - stale > capacity) {
+      const auto victim = eviction.victim(meta_of());
+      if (!stale_entry(victim)) {
+        count(&Counters::evictions);
+      }
+      evict(victim);
+    }
+    std::vector<std::uint32_t> order;
+    order.reserve(occupied);
+    eviction.for_each(meta_of(), [&](const std::uint32_t slot) { order.push_back(slot); });
+
+    // Everything that may throw is allocated before the cache changes
+    detail::buffer<Slot> resized{capacity, resource};
+    detail::slot_index resized_index{capacity, resource};
+    Policy resized_eviction{capacity};
+    detail::buffer<std::size_t> resized_weights;
+    if (weights) {
+      resized_weights = detail::buffer<std::size_t>{capacity, resource};
+    }
+    std::unique_ptr<detail::timer_wheel> resized_wheel;
+    if constexpr (expires) {
+      resized_wheel = std::make_unique<detail::timer_wheel>(capacity, now(), resource);
+    }
+    const auto old_slots = std::exchange(slots, std::move(resized));
+    const auto old_weights = std::exchange(weights, std::move(resized_weights));
+    const auto old_wheel = std::exchange(wheel, std::move(resized_wheel));
+    index = std::move(resized_index);
+    eviction = std::move(resized_eviction);
+    max_entries = capacity;
+    if (!weigher) {
+      max_weight = capacity;
+    }
+    total_weight = stale_weight = 0;
+    occupied = stale = 0;
+    sweep = 0;
+    free_all_slots();
+
+    // Oldest first, so the policy sees them in their original order
+    const auto time = now();
+    for (auto from = order.rbegin(); from != order.rend(); ++from) {
+      auto &[key, val] = old_slots[*from].entry;
+      const auto deadline = old_wheel ? old_wheel->deadline(*from) : detail::never;
+      if (old_slots[*from].epoch != epoch) {
+        count(&Counters::erases);
+      } else if (deadline != detail::never && deadline <= time) {
+        count(&Counters::expirations);
+        count(&Counters::erases);
+      } else {
+        place(std::move(key), old_slots[*from].hash, val, old_weights ? old_weights[*from] : 1, deadline);
+      }
+      old_slots[*from].entry.~pair();
+    }
+  }
+
+  // Empties the cache in O(1) by starting a new generation of entries: the
+  // old ones stay in place but are never found again, and new entries reclaim
+  // their slots before evicting anything live
+  void clear() {
+    if (epoch + 1 == vacant) {
+      // Generations wrap around once every 2^32 - 1 clears: drop everything
+      std::vector<std::uint32_t> cached;
+      eviction.for_each(meta_of(), [&](const std::uint32_t slot) { cached.push_back(slot); });
+      for (const auto slot : cached) {
+        evict(slot);
+      }
+      epoch = 0;
+    } else {
+      ++epoch;
+    }
+    stale = occupied;
+    stale_weight = total_weight;
+    uncached.reset();
+  }
+
+  // With lru::expiring: entries cached from now on live for `ttl`
+  void expire_after(const typename Clock::duration ttl) {
+    expire_after([ttl](Key const &, R const &) { return ttl; });
+  }
+
+  // With lru::expiring: each entry cached from now on lives for
+  // time_to_live(key, value); duration::max() never expires
+  void expire_after(TimeToLive time_to_live) {
+    static_assert(expires, "expire_after needs the lru::expiring option");
+    this->time_to_live = std::move(time_to_live);
+  }
+
+  // With lru::expiring: reclaims the expired entries the timer wheel has
+  // reached, at most a millisecond after they expired. Misses do this too.
+  void evict_expired() {
+    static_assert(expires, "evict_expired needs the lru::expiring option");
+    wheel->advance(now(), [this](const std::uint32_t slot) {
+      count(&Counters::expirations);
+      evict(slot);
+    });
+  }
+
+  // Lower-level access for wrappers that run `func` themselves (see
+  // ConcurrentCache). `hash` must be MapHash{}(key); find and erase also
+  // take a lookup_key of the arguments.
+
+  // What to look the arguments up by, given as a tuple of references to
+  // them: that tuple itself, or their fingerprint with lru::fingerprinted
+  template <typename Probe> static decltype(auto) lookup_key(Probe const &args) noexcept {
+    if constexpr (fingerprinting) {
+      return Key{detail::tuple_fingerprint<Arguments>{}(args)};
+    } else {
+      return (args);
+    }
+  }
+
+  // The Key of an entry looked up by `key`, a lookup_key
+  template <typename Probe> static Key owned_key(Probe const &key) {
+    if constexpr (std::is_same_v<Probe, Key>) {
+      return key;
+    } else {
+      return std::make_from_tuple<Key>(key);
+    }
+  }
+
+  // Returns the cached value and records the hit with the policy, or nullptr
+  // (also for an expired entry, which is left for insert to replace). Safe to
+  // call concurrently with itself when Policy::read_only_hits.
+  template <typename Probe> R const *find(Probe const &key, const std::size_t hash) {
+    const auto slot = lookup(key, hash);
+    if (slot == npos || expired(slot)) {
+      return nullptr;
+    }
+    eviction.on_hit(meta_of(), slot);
+    return &slots[slot].entry.second;
+  }
+
+  // Caches `val` unless `key` is already present; returns the cached value,
+  // or `val` itself if it is too heavy to cache
+  R const &insert(Key key, const std::size_t hash, R &&val) {
+    if (const auto slot = lookup_live(key, hash); slot != npos) {
+      eviction.on_hit(meta_of(), slot);
+      return slots[slot].entry.second;
+    }
+    const auto slot = put(std::move(key), hash, val);
+    return slot == npos ? val : slots[slot].entry.second;
+  }
+
+  // Drops the entry for `key`; returns whether there was one
+  template <typename Probe> bool erase(Probe const &key, const std::size_t hash) {
+    const auto slot = lookup(key, hash);
+    if (slot == npos) {
+      return false;
+    }
+    evict(slot);
+    return true;
   }
 
 private:
-  constexpr void put(Key const &key, R const &val) noexcept {
-    if (cache_list.size() >= capacity) {
-      // Evict LRU => the list back
-      cache_map.erase(cache_list.back().first);
-      cache_list.pop_back();
+  static constexpr std::uint32_t npos = detail::npos;
+  // The epoch of a free slot
+  static constexpr std::uint32_t vacant = npos;
+  static constexpr bool expires = Expiry::enabled;
+  static constexpr bool instrumented = Stats::enabled;
+  static constexpr bool tracing = detail::has_option_v<traced, Options...>;
+  static constexpr bool fingerprinting = detail::has_option_v<fingerprinted, Options...>;
+  // Whether entries are snapshotted as raw bytes
+  static constexpr bool flat_entries = detail::key_layout<Key>::flat && detail::flat_v<R>;
+  static constexpr std::size_t key_bytes = detail::key_layout<Key>::bytes;
+
+  // Names the counters, also when the cache does not keep them
+  using Counters = detail::stat_counters<true>;
+
+  // Bumps one of the stat counters; compiles to nothing without them
+  template <typename Counter> void count([[maybe_unused]] Counter counter) noexcept {
+    if constexpr (instrumented) {
+      ++(this->*counter);
+    }
+  }
+
+  void trace([[maybe_unused]] const std::size_t hash) {
+    if constexpr (tracing) {
+      if (this->recorder) {
+        this->recorder->append(hash);
+      }
+    }
+  }
+
+  // Runs `compute`, timing it into the miss latency histogram
+  template <typename Compute> decltype(auto) timed(Compute &&compute) {
+    if constexpr (instrumented) {
+      const auto start = Stats::clock::now();
+      decltype(auto) result = compute();
+      const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Stats::clock::now() - start);
+      this->miss_latency.record(static_cast<std::uint64_t>(std::max<std::int64_t>(elapsed.count(), 0)));
+      return result;
+    } else {
+      return compute();
+    }
+  }
+
+  using Entry = std::pair<Key, R>;
+
+  // One contiguous array holds every entry together with the policy's
+  // per-entry state (recency links, reference bits...), so a hit touches one
+  // slot and the policy walks its lists by 32-bit index.
+  struct Slot {
+    typename Policy::meta meta;
+    // The clear() generation the entry was cached in, or `vacant`; fills
+    // the padding after the meta of every policy but strict LRU
+    std::uint32_t epoch;
+    std::size_t hash;
+    union {
+      Entry entry;
+    };
+
+    Slot() noexcept {}
+    ~Slot() {}
+  };
+
+  static std::size_t checked_capacity(const std::size_t capacity) {
+    if (capacity == 0 || capacity >= npos) {
+      throw std::length_error("lru::Cache capacity must be in [1, 2^32 - 1)");
+    }
+    return capacity;
+  }
+
+  // What the policy sees of the slots: at(slot) is the slot's meta and
+  // at.hash(slot) the hash it was inserted with
+  struct MetaAccess {
+    Slot *slots;
+
+    typename Policy::meta &operator()(const std::uint32_t slot) const noexcept { return slots[slot].meta; }
+    std::size_t hash(const std::uint32_t slot) const noexcept { return slots[slot].hash; }
+  };
+
+  MetaAccess meta_of() const noexcept { return {slots.get()}; }
+
+  // `key` is the Key or a probe tuple of matching elements. Entries left by
+  // clear() are not found.
+  template <typename Probe> std::uint32_t lookup(Probe const &key, const std::size_t hash) const {
+    return index.find(hash, [&](const std::uint32_t slot) {
+      return slots[slot].hash == hash && slots[slot].epoch == epoch &&
+             detail::tuple_equal<Key>{}(slots[slot].entry.first, key);
+    });
+  }
+
+  // Whether `slot` holds an entry left by clear()
+  bool stale_entry(const std::uint32_t slot) const noexcept {
+    return slots[slot].epoch != epoch && slots[slot].epoch != vacant;
+  }
+
+  // Evicts the next entry left by clear(), sweeping the slots round-robin
+  // from where the last call stopped
+  void reclaim_stale() {
+    while (!stale_entry(sweep)) {
+      sweep = sweep + 1 == max_entries ? 0 : sweep + 1;
+    }
+    evict(sweep);
+  }
+
+  // Chains every slot into the free list through `meta.next`, lowest index
+  // first
+  void free_all_slots() noexcept {
+    free_list = npos;
+    for (auto i = static_cast<std::uint32_t>(max_entries); i-- > 0;) {
+      slots[i].epoch = vacant;
+      slots[i].meta.next = std::exchange(free_list, i);
+    }
+  }
+
+  // For each of get_many's missed keys, the index of the first one equal to
+  // it. Sorted by hash, equal keys are neighbours up to hash collisions.
+  static std::vector<std::size_t> first_copies(std::vector<Key> const &missed,
+                                               std::vector<std::pair<std::size_t, std::size_t>> const &missed_at) {
+    std::vector<std::size_t> order(missed.size());
+    for (std::size_t i = 0; i < order.size(); ++i) {
+      order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](const std::size_t a, const std::size_t b) {
+      return std::make_pair(missed_at[a].second, a) < std::make_pair(missed_at[b].second, b);
+    });
+    std::vector<std::size_t> first(missed.size());
+    for (std::size_t run = 0, end = 0; run < order.size(); run = end) {
+      while (end < order.size() && missed_at[order[end]].second == missed_at[order[run]].second) {
+        ++end;
+      }
+      // Within a run of equal hashes, indices ascend: the first equal key
+      // found is the first copy
+      for (std::size_t i = run; i < end; ++i) {
+        std::size_t j = run;
+        while (!detail::tuple_equal<Key>{}(missed[order[j]], missed[order[i]])) {
+          ++j;
+        }
+        first[order[i]] = order[j];
+      }
+    }
+    return first;
+  }
+
+  // The cached value for the arguments `args`, or else the one `miss(key)`
+  // computes for their lookup_key along with its Key, which is moved into
+  // a slot
+  template <typename Probe, typename Miss> R const &get_or_compute(Probe const &args, Miss &&miss) {
+    decltype(auto) probe = lookup_key(args);
+    const auto hash = MapHash{}(probe);
+    trace(hash);
+    if (const auto slot = lookup_live(probe, hash); slot != npos) {
+      count(&Counters::hits);
+      eviction.on_hit(meta_of(), slot);
+      return slots[slot].entry.second;
+    }
+    count(&Counters::misses);
+    auto computed = timed([&] { return miss(probe); });
+    const auto slot = put(std::move(computed.first), hash, computed.second);
+    if (slot == npos) {
+      // Too heavy to cache: held until the next call
+      return uncached.emplace(std::move(computed.second));
+    }
+    return slots[slot].entry.second;
+  }
+
+  // A get_many element seen as a probe, and as an owning Key
+  template <typename T> static decltype(auto) probe_of(T const &key) {
+    if constexpr (std::is_same_v<T, Key>) {
+      return key;
+    } else {
+      static_assert(sizeof...(Args) == 1, "get_many takes Keys, or arguments of a one-argument function");
+      return std::tuple<detail::probe_element_t<std::decay_t<Args>, T>...>{key};
+    }
+  }
+
+  template <typename T> static Key key_of(T const &key) {
+    if constexpr (std::is_same_v<T, Key>) {
+      return key;
+    } else {
+      return Key{std::decay_t<Args>(key)...};
+    }
+  }
+
+  // Like lookup, but drops the entry instead if it has expired
+  template <typename Probe> std::uint32_t lookup_live(Probe const &key, const std::size_t hash) {
+    const auto slot = lookup(key, hash);
+    if (slot != npos && expired(slot)) {
+      count(&Counters::expirations);
+      evict(slot);
+      return npos;
     }
-    // Insert new item at the front
-    cache_list.emplace_front(key, val);
-    cache_map[key] = cache_list.begin();
+    return slot;
   }
 
-  const Function func;
+  // Nanoseconds since the clock's epoch
+  static std::int64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+  }
 
-  std::vector<std::pair<Key, R>> buffer;
-  std::pmr::monotonic_buffer_resource mbr{buffer.data(),
-                                          buffer.size() * sizeof(buffer[0])};
-  std::pmr::polymorphic_allocator<std::pair<Key, R>> pa{&mbr};
+  bool expired(const std::uint32_t slot) const {
+    if constexpr (expires) {
+      const auto deadline = wheel->deadline(slot);
+      return deadline != detail::never && deadline <= now();
+    }
+    return false;
+  }
+
+  // When an entry cached now expires
+  std::int64_t deadline_of(Key const &key, R const &val) const {
+    if (!time_to_live) {
+      return detail::never;
+    }
+    const auto ttl = time_to_live(key, val);
+    if (ttl == Clock::duration::max()) {
+      return detail::never;
+    }
+    const auto start = now();
+    const auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(ttl).count();
+    return nanos >= detail::never - start ? detail::never : start + nanos;
+  }
+
+  // Moves `val` into a slot and returns it, or returns npos and leaves `val`
+  // alone if it weighs more than the whole budget
+  std::uint32_t put(Key &&key, const std::size_t hash, R &val) {
+    const std::size_t w = weigher ? weigher(key, val) : 1;
+    if (w > max_weight) {
+      return npos;
+    }
+    std::int64_t deadline = detail::never;
+    if constexpr (expires) {
+      deadline = deadline_of(key, val);
+      evict_expired();
+    }
+    // Reclaim the entries left by clear(), then evict the policy's victims,
+    // until both a slot and the weight are free
+    while (free_list == npos || w > max_weight - total_weight) {
+      if (stale > 0) {
+        reclaim_stale();
+      } else {
+        count(&Counters::evictions);
+        evict(eviction.victim(meta_of()));
+      }
+    }
+    count(&Counters::inserts);
+    return place(std::move(key), hash, val, w, deadline);
+  }
 
-  std::pmr::list<std::pair<Key, R>> cache_list{pa};
-  using ListIt = typename decltype(cache_list)::iterator;
+  // Moves the entry into a free slot, which there must be
+  std::uint32_t place(Key &&key, const std::size_t hash, R &val, const std::size_t w,
+                      [[maybe_unused]] const std::int64_t deadline) {
+    const auto slot = free_list;
+    ::new (&slots[slot].entry) Entry(std::move(key), std::move(val));
+    free_list = slots[slot].meta.next;
+    slots[slot].epoch = epoch;
+    slots[slot].hash = hash;
+    if (weights) {
+      weights[slot] = w;
+    }
+    total_weight += w;
+    ++occupied;
+    if constexpr (expires) {
+      wheel->schedule(slot, deadline);
+    }
+    eviction.on_insert(meta_of(), slot);
+    index.insert(hash, slot);
+    return slot;
+  }
 
-  emhash7::HashMap<Key, ListIt, MapHash> cache_map;
+  // The slots of the unexpired entries, in the policy's order: most recently
+  // used first for strict LRU
+  std::vector<std::uint32_t> live_slots() const {
+    std::vector<std::uint32_t> live;
+    eviction.for_each(meta_of(), [&](const std::uint32_t slot) {
+      if (!expired(slot) && !stale_entry(slot)) {
+        live.push_back(slot);
+      }
+    });
+    return live;
+  }
+
+  void write_snapshot_header(detail::snapshot_file &file, const bool flat, const std::size_t count) const {
+    detail::snapshot_header header{};
+    std::memcpy(header.magic, detail::snapshot_header::signature, sizeof(header.magic));
+    header.flat = flat;
+    header.capacity = max_entries;
+    header.count = count;
+    header.key_bytes = flat ? key_bytes : 0;
+    header.value_bytes = flat ? sizeof(R) : 0;
+    file.write(&header, sizeof(header));
+  }
+
+  // Drops the entry in `slot` and recycles the slot
+  void evict(const std::uint32_t slot) {
+    count(&Counters::erases);
+    index.erase(slots[slot].hash, slot);
+    eviction.on_erase(meta_of(), slot);
+    if constexpr (expires) {
+      wheel->cancel(slot);
+    }
+    const std::size_t w = weights ? weights[slot] : 1;
+    if (stale_entry(slot)) {
+      --stale;
+      stale_weight -= w;
+    }
+    total_weight -= w;
+    --occupied;
+    slots[slot].entry.~pair();
+    slots[slot].epoch = vacant;
+    slots[slot].meta.next = std::exchange(free_list, slot);
+  }
+
+  std::size_t max_entries;
+  std::size_t max_weight;
+  std::size_t total_weight = 0;
+  std::size_t occupied = 0;
+  // Entries left by clear() and not reclaimed yet, and their weight
+  std::size_t stale = 0;
+  std::size_t stale_weight = 0;
+  std::uint32_t epoch = 0;
+  // Where reclaim_stale resumes
+  std::uint32_t sweep = 0;
+  Weigher weigher;
+  // Weight of each occupied slot, only allocated along with a weigher
+  detail::buffer<std::size_t> weights;
+  TimeToLive time_to_live;
+  // The last result that was too heavy to cache, see get
+  std::optional<R> uncached;
+  // Expiry timers of the slots, only with lru::expiring
+  std::unique_ptr<detail::timer_wheel> wheel;
+
+  // Not const: a callable may have a mutable operator()
+  Function func;
+
+  std::pmr::memory_resource *resource;
+  detail::buffer<Slot> slots;
+  std::uint32_t free_list = npos;
+  detail::slot_index index;
+  Policy eviction;
 };
 
-template <typename F> auto make_cache(F &&f, std::size_t capacity = 1024) {
-  using traits = detail::function_traits<std::decay_t<F>>;
-  using ArgsT = typename traits::argument_types;
-  constexpr std::size_t N = std::tuple_size_v<ArgsT>;
+// The default cache: strict LRU eviction
+template <typename R, typename... Args> using Cache = BasicCache<R(Args...)>;
 
-  return detail::make_cache_helper(std::forward<F>(f), capacity,
-                                   std::make_index_sequence<N>{});
+// `Options` are forwarded to BasicCache, e.g. make_cache<lru::policy::clock>(f).
+// `f` (a function pointer, lambda or functor) is stored by value.
+template <typename... Options, typename F>
+auto make_cache(F &&f, std::size_t capacity = 1024,
+                std::pmr::memory_resource *resource = std::pmr::get_default_resource()) {
+  using Signature = typename detail::function_traits<std::decay_t<F>>::signature;
+  return BasicCache<Signature, callable<std::decay_t<F>>, Options...>(std::forward<F>(f), capacity, resource);
 }
 
+// Weighted cache: at most `capacity` entries of at most `max_weight` in total
+template <typename... Options, typename F, typename W>
+auto make_cache(F &&f, std::size_t capacity, W &&weigher, std::size_t max_weight,
+                std::pmr::memory_resource *resource = std::pmr::get_default_resource()) {
+  using Signature = typename detail::function_traits<std::decay_t<F>>::signature;
+  return BasicCache<Signature, callable<std::decay_t<F>>, Options...>(std::forward<F>(f), capacity,
+                                                                       std::forward<W>(weigher), max_weight, resource);
+}
+
+// Caches the function `Fn` given at compile time, e.g. make_cache<&fn>()
+template <auto Fn, typename... Options, typename = std::enable_if_t<!std::is_member_function_pointer_v<decltype(Fn)>>>
+auto make_cache(std::size_t capacity = 1024) {
+  using Signature = typename detail::function_traits<decltype(Fn)>::signature;
+  return BasicCache<Signature, callable<detail::function_constant<Fn>>, Options...>({}, capacity);
+}
+
+// Caches the member function `Fn` of `object`, which must outlive the cache,
+// e.g. make_cache<&Parser::parse>(parser)
+template <auto Fn, typename... Options, typename ClassType,
+          typename = std::enable_if_t<std::is_member_function_pointer_v<decltype(Fn)>>>
+auto make_cache(ClassType &object, std::size_t capacity = 1024) {
+  using Signature = typename detail::function_traits<decltype(Fn)>::signature;
+  return BasicCache<Signature, callable<detail::bound_member<Fn, ClassType>>, Options...>({&object}, capacity);
+}
+
+// Handle through which a function memoized by make_recursive_cache calls
+// itself: self(args...) looks the arguments up in the same cache. It returns
+// by value, as the nested miss may evict any entry, including ones the
+// calling frames have looked up.
+template <typename Signature> class recursive;
+
+template <typename R, typename... Args> class recursive<R(Args...)> {
+public:
+  R operator()(Args... args) const { return call(cache, std::forward<Args>(args)...); }
+
+private:
+  template <typename Signature, typename... Options> friend class BasicRecursiveCache;
+  recursive(void *cache, R (*call)(void *, Args...)) noexcept : cache{cache}, call{call} {}
+
+  void *cache;
+  R (*call)(void *, Args...);
+};
+
 namespace detail {
 
-template <typename F, std::size_t... I>
-auto make_cache_helper(F &&f, std::size_t capacity, std::index_sequence<I...>) {
-  using traits = detail::function_traits<std::decay_t<F>>;
-  using R = typename traits::return_type;
-  using ArgsT = typename traits::argument_types;
+// The signature of a recursive function without its handle parameter
+template <typename Signature> struct recursive_signature;
+template <typename R, typename Self, typename... Args> struct recursive_signature<R(Self, Args...)> {
+  using type = R(Args...);
+  static_assert(std::is_same_v<std::decay_t<Self>, recursive<type>>,
+                "the first parameter of a recursive function must be an lru::recursive<R(Args...)> reference");
+};
+
+// Calls the function of the recursive cache `Owner` with its handle
+template <typename Owner> struct recursive_call {
+  Owner *owner;
+  template <typename... Ts> decltype(auto) operator()(Ts &&...ts) const {
+    return owner->func(owner->self, std::forward<Ts>(ts)...);
+  }
+};
+
+} // namespace detail
+
+template <typename Signature, typename... Options> class BasicRecursiveCache;
 
-  // Expand the argument types directly in the Cache template parameters:
-  return Cache<R, std::tuple_element_t<I, ArgsT>...>(std::forward<F>(f),
-                                                     capacity);
+// Memoizes a recursive function of signature R(recursive<R(Args...)> &,
+// Args...) whose recursive calls go through the handle, and so through the
+// cache: DP-style recursion without a global cache for the function to refer
+// to. The function may capture its context (a word list, a grid...) and is
+// stored by value. This is a BasicCache with all of its options and members,
+// only its function receives the handle.
+template <typename R, typename... Args, typename... Options>
+class BasicRecursiveCache<R(Args...), Options...>
+    : public BasicCache<R(Args...), callable<detail::recursive_call<BasicRecursiveCache<R(Args...), Options...>>>,
+                        Options...> {
+  using Base = BasicCache<R(Args...), callable<detail::recursive_call<BasicRecursiveCache>>, Options...>;
+  friend struct detail::recursive_call<BasicRecursiveCache>;
+
+public:
+  using Self = recursive<R(Args...)>;
+  using Function =
+      typename detail::select_option_t<detail::callable_option, callable<std::function<R(Self &, Args...)>>,
+                                       Options...>::type;
+
+  explicit BasicRecursiveCache(Function func, std::size_t capacity = 1024)
+      : Base{{this}, capacity}, func{std::move(func)}, self{this, &call} {}
+
+  BasicRecursiveCache(Function func, std::size_t capacity, typename Base::Weigher weigher, std::size_t max_weight)
+      : Base{{this}, capacity, std::move(weigher), max_weight}, func{std::move(func)}, self{this, &call} {}
+
+private:
+  static R call(void *cache, Args... args) {
+    return (*static_cast<BasicRecursiveCache *>(cache))(std::forward<Args>(args)...);
+  }
+
+  Function func;
+  Self self;
+};
+
+// `f` takes an lru::recursive<R(Args...)> & first and calls it for its
+// recursive calls, e.g.
+//   make_recursive_cache([](lru::recursive<long(int)> &fib, int n) {
+//     return n < 2 ? long(n) : fib(n - 1) + fib(n - 2);
+//   });
+// `Options` are forwarded to BasicRecursiveCache and `f` is stored by value.
+template <typename... Options, typename F> auto make_recursive_cache(F &&f, std::size_t capacity = 1024) {
+  using Signature =
+      typename detail::recursive_signature<typename detail::function_traits<std::decay_t<F>>::signature>::type;
+  return BasicRecursiveCache<Signature, callable<std::decay_t<F>>, Options...>(std::forward<F>(f), capacity);
 }
 
+template <typename... Options, typename F, typename W>
+auto make_recursive_cache(F &&f, std::size_t capacity, W &&weigher, std::size_t max_weight) {
+  using Signature =
+      typename detail::recursive_signature<typename detail::function_traits<std::decay_t<F>>::signature>::type;
+  return BasicRecursiveCache<Signature, callable<std::decay_t<F>>, Options...>(std::forward<F>(f), capacity,
+                                                                                std::forward<W>(weigher), max_weight);
+}
+
+namespace detail {
+
+// Keys whose elements are all bytewise_v are packed and hashed as bytes
+template <typename... Args> inline constexpr bool packed_key_v = sizeof...(Args) > 0 && (bytewise_v<Args> && ...);
+
+template <typename... Args> struct tuple_equal;
+template <typename... Args> struct tuple_equal<std::tuple<Args...>> {
+  // Compares a key with a key or probe tuple: bytewise for packed keys,
+  // element by element otherwise, with floating point elements still
+  // compared by their value bytes
+  template <typename Probe> bool operator()(std::tuple<Args...> const &key, Probe const &probe) const noexcept {
+    if constexpr (packed_key_v<Args...>) {
+      return equal_bytes(key, probe, std::index_sequence_for<Args...>{});
+    } else {
+      return equal_elements(key, probe, std::index_sequence_for<Args...>{});
+    }
+  }
+
+private:
+  template <typename Probe, std::size_t... I>
+  static bool equal_elements(std::tuple<Args...> const &key, Probe const &probe, std::index_sequence<I...>) noexcept {
+    return (element_equal<Args>(std::get<I>(key), std::get<I>(probe)) && ...);
+  }
+
+  template <typename Elem, typename V> static bool element_equal(Elem const &elem, V const &val) noexcept {
+    if constexpr (std::is_floating_point_v<Elem>) {
+      const Elem other = val;
+      return std::memcmp(&elem, &other, value_bytes_v<Elem>) == 0;
+    } else {
+      return elem == val;
+    }
+  }
+
+  template <typename Probe, std::size_t... I>
+  static bool equal_bytes(std::tuple<Args...> const &key, Probe const &probe, std::index_sequence<I...>) noexcept {
+    return ((std::memcmp(&std::get<I>(key), &static_cast<Args const &>(std::get<I>(probe)), sizeof(Args)) == 0) &&
+            ...);
+  }
+};
+
 template <typename... Args> struct tuple_hash;
 template <typename... Args> struct tuple_hash<std::tuple<Args...>> {
-  std::size_t operator()(std::tuple<Args...> const &tpl) const noexcept {
-    if constexpr (sizeof...(Args) == 1) {
+  // Hashes a key, or a probe tuple holding its elements by reference, as
+  // views of its strings or converted (see probe_element_t) to the same value
+  template <typename... Ts> std::size_t operator()(std::tuple<Ts...> const &tpl) const noexcept {
+    static_assert(sizeof...(Ts) == sizeof...(Args), "probe and key differ in length");
+    if constexpr (packed_key_v<Args...>) {
+      // All trivially copyable => one pass over the packed bytes
+      byte_hasher hasher{(sizeof(Args) + ...)};
+      std::apply([&](auto const &...vals) { (hasher.add(static_cast<Args const &>(vals)), ...); }, tpl);
+      return static_cast<std::size_t>(hasher.finish());
+    } else if constexpr (sizeof...(Args) == 1) {
       // Single element tuple => direct
-      using T0 = std::tuple_element_t<0, std::tuple<Args...>>;
-      return std::hash<T0>{}(std::get<0>(tpl));
+      return element_hash<Args...>(std::get<0>(tpl));
     } else {
       // 2+ elements => combine
-      std::size_t seed = 0;
-      std::apply([&](auto const &...vals) { (..., hash_combine(seed, vals)); },
-                 tpl);
-      return seed;
+      return combine(tpl, std::index_sequence_for<Args...>{});
     }
   }
 
@@ -150,9 +1178,30 @@ private:
     return c * xorshift(p * xorshift(n, 32), 32);
   }
 
-  template <typename V>
-  static constexpr std::size_t hash_combine(const std::size_t seed, V const &val) {
-    const auto distributed = [h = std::hash<V>{}(val)] {
+  // std::hash of a string and of its view agree. Floating point values are
+  // hashed by their value bytes, as tuple_equal compares them.
+  template <typename Elem, typename V> static std::size_t element_hash(V const &val) noexcept {
+    if constexpr (string_traits<Elem>::value) {
+      return std::hash<typename string_traits<Elem>::view>{}(val);
+    } else if constexpr (std::is_floating_point_v<Elem>) {
+      const Elem elem = val;
+      byte_hasher hasher{value_bytes_v<Elem>};
+      hasher.add_bytes(&elem, value_bytes_v<Elem>);
+      return static_cast<std::size_t>(hasher.finish());
+    } else {
+      return std::hash<Elem>{}(val);
+    }
+  }
+
+  template <typename Tuple, std::size_t... I>
+  static std::size_t combine(Tuple const &tpl, std::index_sequence<I...>) noexcept {
+    std::size_t seed = 0;
+    ((seed = hash_combine(seed, element_hash<Args>(std::get<I>(tpl)))), ...);
+    return seed;
+  }
+
+  static constexpr std::size_t hash_combine(const std::size_t seed, const std::size_t h) {
+    const auto distributed = [h] {
       static_assert(sizeof(std::size_t) == 4 || sizeof(std::size_t) == 8,
                     "non-standard size_t is not supported");
       if constexpr (sizeof(std::size_t) == 4) {
@@ -166,6 +1215,72 @@ private:
   }
 };
 
+// The 128-bit hash of a key or probe tuple that lru::fingerprinted stores:
+// the hash of packed keys (see tuple_hash) in both fingerprint_hasher lanes,
+// extended to padded floating point values (their value bytes), and to
+// strings and byte vectors, which are hashed as their length followed by
+// their contents so that ("ab", "c") and ("a", "bc") differ
+template <typename... Args> struct tuple_fingerprint<std::tuple<Args...>> {
+  static_assert(((bytewise_v<Args> || std::is_floating_point_v<Args> || string_traits<Args>::value ||
+                  byte_vector_v<Args>)&&...),
+                "lru::fingerprinted needs trivially copyable arguments, strings or vectors of trivially copyable "
+                "elements");
+
+  template <typename... Ts> fingerprint operator()(std::tuple<Ts...> const &tpl) const noexcept {
+    static_assert(sizeof...(Ts) == sizeof...(Args), "probe and key differ in length");
+    return hash(tpl, std::index_sequence_for<Args...>{});
+  }
+
+private:
+  template <typename Tuple, std::size_t... I>
+  static fingerprint hash(Tuple const &tpl, std::index_sequence<I...>) noexcept {
+    fingerprint_hasher hasher{(length<Args>(std::get<I>(tpl)) + ... + 0)};
+    (add<Args>(hasher, std::get<I>(tpl)), ...);
+    return hasher.finish();
+  }
+
+  // Bytes hashed for an element
+  template <typename Elem, typename V> static std::size_t length(V const &val) noexcept {
+    if constexpr (bytewise_v<Elem>) {
+      return sizeof(Elem);
+    } else if constexpr (std::is_floating_point_v<Elem>) {
+      return value_bytes_v<Elem>;
+    } else {
+      auto const &contents = contents_of<Elem>(val);
+      return sizeof(std::size_t) + contents.size() * sizeof(contents[0]);
+    }
+  }
+
+  template <typename Elem, typename V> static void add(fingerprint_hasher &hasher, V const &val) noexcept {
+    if constexpr (bytewise_v<Elem>) {
+      hasher.add(static_cast<Elem const &>(val));
+    } else if constexpr (std::is_floating_point_v<Elem>) {
+      const Elem elem = val;
+      hasher.add_bytes(&elem, value_bytes_v<Elem>);
+    } else {
+      auto const &contents = contents_of<Elem>(val);
+      hasher.add(static_cast<std::size_t>(contents.size()));
+      hasher.add_bytes(contents.data(), contents.size() * sizeof(contents[0]));
+    }
+  }
+
+  // A string as its view, which is what heterogeneous calls pass, or a vector
+  template <typename Elem, typename V> static decltype(auto) contents_of(V const &val) noexcept {
+    if constexpr (string_traits<Elem>::value) {
+      return typename string_traits<Elem>::view{val};
+    } else {
+      return static_cast<Elem const &>(val);
+    }
+  }
+};
+
+// A fingerprint is a hash already: its low half serves as the table hash
+template <> struct tuple_hash<std::tuple<fingerprint>> {
+  template <typename Probe> std::size_t operator()(Probe const &tpl) const noexcept {
+    return static_cast<std::size_t>(std::get<0>(tpl).low);
+  }
+};
+
 } // namespace detail
 
 } // namespace lru
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <utility>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace lru {
+
+namespace detail {
+
+// Array of `size` default-initialized T allocated from a memory resource,
+// which must outlive it. Stands in for std::unique_ptr<T[]> wherever a
+// cache's per-entry storage is allocated.
+template <typename T> class buffer {
+public:
+  buffer() noexcept = default;
+
+  buffer(const std::size_t size, std::pmr::memory_resource *resource)
+      : length{size}, resource{resource},
+        data{static_cast<T *>(resource->allocate(size * sizeof(T), alignof(T)))} {
+    try {
+      std::uninitialized_default_construct_n(data, size);
+    } catch (...) {
+      resource->deallocate(data, size * sizeof(T), alignof(T));
+      throw;
+    }
+  }
+
+  buffer(buffer &&other) noexcept
+      : length{std::exchange(other.length, 0)}, resource{other.resource}, data{std::exchange(other.data, nullptr)} {}
+
+  buffer &operator=(buffer &&other) noexcept {
+    buffer{std::move(other)}.swap(*this);
+    return *this;
+  }
+
+  ~buffer() {
+    if (data) {
+      std::destroy_n(data, length);
+      resource->deallocate(data, length * sizeof(T), alignof(T));
+    }
+  }
+
+  void swap(buffer &other) noexcept {
+    std::swap(length, other.length);
+    std::swap(resource, other.resource);
+    std::swap(data, other.data);
+  }
+
+  T &operator[](const std::size_t i) const noexcept { return data[i]; }
+  T *get() const noexcept { return data; }
+  explicit operator bool() const noexcept { return data != nullptr; }
+
+private:
+  std::size_t length = 0;
+  std::pmr::memory_resource *resource = nullptr;
+  T *data = nullptr;
+};
+
+} // namespace detail
+
+// Number of NUMA nodes the kernel reports, 1 where it reports none
+inline std::size_t numa_nodes() {
+  std::size_t nodes = 0;
+#if defined(__linux__)
+  while (::access(("/sys/devices/system/node/node" + std::to_string(nodes)).c_str(), F_OK) == 0) {
+    ++nodes;
+  }
+#endif
+  return nodes > 0 ? nodes : 1;
+}
+
+// Memory resource for the storage of large caches, cutting TLB misses and
+// remote-node accesses. Each allocation of at least a huge page (2 MiB) gets
+// its own anonymous mapping: from the reserved huge pages (MAP_HUGETLB) if
+// any are free, else from regular pages aligned to and rounded up to huge
+// pages, with MADV_HUGEPAGE asking for transparent huge pages. With a
+// `node`, the mapping is bound to that NUMA node (mbind) before it is
+// touched. Smaller allocations, and every allocation off Linux, come from
+// `upstream`.
+//
+// Every step degrades quietly: no reserved huge pages, transparent huge
+// pages disabled or a kernel without NUMA leave the memory on regular pages
+// or on any node. Only a failed mapping throws std::bad_alloc. Thread-safe;
+// must outlive what it allocated.
+class huge_page_resource : public std::pmr::memory_resource {
+public:
+  static constexpr std::size_t huge_page = std::size_t{1} << 21;
+  static constexpr int any_node = -1;
+
+  explicit huge_page_resource(const int node = any_node,
+                              std::pmr::memory_resource *upstream = std::pmr::get_default_resource()) noexcept
+      : node{node}, upstream{upstream} {}
+
+  int numa_node() const noexcept { return node; }
+
+private:
+  void *do_allocate(const std::size_t bytes, const std::size_t alignment) override {
+    if (bytes < huge_page || alignment > huge_page) {
+      return upstream->allocate(bytes, alignment);
+    }
+#if defined(__linux__)
+    const auto length = round_up(bytes);
+    void *mapping = MAP_FAILED;
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+    mapping = ::mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (21 << MAP_HUGE_SHIFT), -1, 0);
+#endif
+    if (mapping == MAP_FAILED) {
+      mapping = map_aligned(length);
+#if defined(MADV_HUGEPAGE)
+      ::madvise(mapping, length, MADV_HUGEPAGE);
+#endif
+    }
+    bind(mapping, length);
+    return mapping;
+#else
+    return upstream->allocate(bytes, alignment);
+#endif
+  }
+
+  void do_deallocate(void *p, const std::size_t bytes, const std::size_t alignment) override {
+    if (bytes < huge_page || alignment > huge_page) {
+      upstream->deallocate(p, bytes, alignment);
+      return;
+    }
+#if defined(__linux__)
+    ::munmap(p, round_up(bytes));
+#else
+    upstream->deallocate(p, bytes, alignment);
+#endif
+  }
+
+  bool do_is_equal(std::pmr::memory_resource const &other) const noexcept override { return this == &other; }
+
+  static std::size_t round_up(const std::size_t bytes) noexcept { return (bytes + huge_page - 1) & ~(huge_page - 1); }
+
+#if defined(__linux__)
+  // Maps `length` bytes at a huge page boundary, so transparent huge pages
+  // can back all of them: maps one huge page more and unmaps the ends
+  static void *map_aligned(const std::size_t length) {
+    void *mapping = ::mmap(nullptr, length + huge_page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+      throw std::bad_alloc{};
+    }
+    const auto start = reinterpret_cast<std::uintptr_t>(mapping);
+    const auto aligned = (start + huge_page - 1) & ~std::uintptr_t{huge_page - 1};
+    if (aligned > start) {
+      ::munmap(mapping, aligned - start);
+    }
+    if (const auto tail = start + huge_page - aligned; tail > 0) {
+      ::munmap(reinterpret_cast<void *>(aligned + length), tail);
+    }
+    return reinterpret_cast<void *>(aligned);
+  }
+
+  void bind(void *mapping, const std::size_t length) const noexcept {
+#if defined(SYS_mbind)
+    constexpr std::size_t max_nodes = 1024;
+    constexpr std::size_t word = 8 * sizeof(unsigned long);
+    if (node < 0 || static_cast<std::size_t>(node) >= max_nodes) {
+      return;
+    }
+    unsigned long mask[max_nodes / word] = {};
+    mask[node / word] = 1UL << (node % word);
+    // MPOL_BIND of <linux/mempolicy.h>. The kernel reads maxnode - 1 bits.
+    constexpr int bind_policy = 2;
+    ::syscall(SYS_mbind, mapping, length, bind_policy, mask, max_nodes + 1, 0);
+#else
+    static_cast<void>(mapping);
+    static_cast<void>(length);
+#endif
+  }
+#endif
+
+  int node;
+  std::pmr::memory_resource *upstream;
+};
+
+} // namespace lru
@@ -0,0 +1,509 @@
+#pragma once
+
+#include "index.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+
+namespace lru {
+
+namespace detail {
+
+// Tag base of every eviction policy, see select_option
+struct eviction_option {};
+
+// Recency links of a slot, as indices into the cache's slot array
+struct slot_links {
+  std::uint32_t prev;
+  std::uint32_t next;
+};
+
+// Doubly-linked list threaded through the links stored in the slots; it only
+// owns its ends. `at(slot)` returns the slot_links of a slot.
+class slot_list {
+public:
+  std::uint32_t front() const noexcept { return head; }
+  std::uint32_t back() const noexcept { return tail; }
+  std::size_t size() const noexcept { return count; }
+  bool empty() const noexcept { return count == 0; }
+
+  template <typename At> void push_front(At &&at, const std::uint32_t slot) noexcept {
+    auto &links = at(slot);
+    links.prev = npos;
+    links.next = head;
+    (head != npos ? at(head).prev : tail) = slot;
+    head = slot;
+    ++count;
+  }
+
+  template <typename At> void erase(At &&at, const std::uint32_t slot) noexcept {
+    const auto &links = at(slot);
+    (links.prev != npos ? at(links.prev).next : head) = links.next;
+    (links.next != npos ? at(links.next).prev : tail) = links.prev;
+    --count;
+  }
+
+  template <typename At> void move_to_front(At &&at, const std::uint32_t slot) noexcept {
+    if (slot != head) {
+      erase(at, slot);
+      push_front(at, slot);
+    }
+  }
+
+  // Front (most recent) to back
+  template <typename At, typename F> void for_each(At &&at, F &&f) const {
+    for (auto slot = head; slot != npos;) {
+      const auto next = at(slot).next;
+      f(slot);
+      slot = next;
+    }
+  }
+
+private:
+  std::uint32_t head = npos;
+  std::uint32_t tail = npos;
+  std::size_t count = 0;
+};
+
+// Count-min sketch of access frequencies with 4-bit saturating counters, 16
+// per word, four counters per key and one word per cached entry (as in
+// Caffeine). Every `sample` increments all counters are halved, so old
+// popularity fades (the TinyLFU reset).
+class frequency_sketch {
+public:
+  explicit frequency_sketch(const std::size_t capacity)
+      : mask{ceil_pow2(std::max<std::size_t>(capacity, 8)) - 1}, sample{10 * std::max<std::size_t>(capacity, 8)},
+        table{new std::uint64_t[mask + 1]()} {}
+
+  void increment(const std::size_t hash) noexcept {
+    bool added = false;
+    for (unsigned row = 0; row < 4; ++row) {
+      const auto [word, shift] = locate(hash, row);
+      if (((table[word] >> shift) & 0xF) != 0xF) {
+        table[word] += std::uint64_t{1} << shift;
+        added = true;
+      }
+    }
+    if (added && ++additions == sample) {
+      reset();
+    }
+  }
+
+  unsigned estimate(const std::size_t hash) const noexcept {
+    unsigned frequency = 0xF;
+    for (unsigned row = 0; row < 4; ++row) {
+      const auto [word, shift] = locate(hash, row);
+      frequency = std::min(frequency, static_cast<unsigned>((table[word] >> shift) & 0xF));
+    }
+    return frequency;
+  }
+
+private:
+  struct counter {
+    std::size_t word;
+    unsigned shift;
+  };
+
+  // Each row remixes the hash with its own seed: the word comes from the low
+  // bits, the nibble inside the word from the top four
+  counter locate(const std::size_t hash, const unsigned row) const noexcept {
+    static constexpr std::uint64_t seeds[] = {0xC3A5C85C97CB3127ULL, 0xB492B66FBE98F273ULL, 0x9AE16A3B2F90404FULL,
+                                              0xCBF29CE484222325ULL};
+    auto h = (static_cast<std::uint64_t>(hash) + seeds[row]) * 0x9E3779B97F4A7C15ULL;
+    h ^= h >> 29;
+    return {static_cast<std::size_t>(h) & mask, static_cast<unsigned>(h >> 60) * 4};
+  }
+
+  void reset() noexcept {
+    for (std::size_t i = 0; i <= mask; ++i) {
+      table[i] = (table[i] >> 1) & 0x7777777777777777ULL;
+    }
+    additions /= 2;
+  }
+
+  std::size_t mask;
+  std::size_t sample;
+  std::size_t additions = 0;
+  std::unique_ptr<std::uint64_t[]> table;
+};
+
+// FIFO of the hashes of recently evicted keys, with an index for membership
+// tests. Once full, each push forgets the oldest hash.
+class ghost_queue {
+public:
+  explicit ghost_queue(const std::size_t capacity)
+      : capacity{static_cast<std::uint32_t>(capacity)}, hashes{new std::size_t[capacity]}, index{capacity} {}
+
+  bool contains(const std::size_t hash) const {
+    return index.find(hash, [&](const std::uint32_t pos) { return hashes[pos] == hash; }) != npos;
+  }
+
+  void push(const std::size_t hash) noexcept {
+    if (count == capacity) {
+      index.erase(hashes[next], next);
+    } else {
+      ++count;
+    }
+    hashes[next] = hash;
+    index.insert(hash, next);
+    next = next + 1 == capacity ? 0 : next + 1;
+  }
+
+private:
+  std::uint32_t capacity;
+  std::uint32_t count = 0;
+  std::uint32_t next = 0;
+  std::unique_ptr<std::size_t[]> hashes;
+  slot_index index;
+};
+
+} // namespace detail
+
+// Eviction policies. Each one keeps its per-entry state in `meta`, which the
+// cache embeds in the slot next to the entry, and is driven through:
+//   on_insert(at, slot)  a new entry was stored in `slot`
+//   on_hit(at, slot)     `slot` was looked up
+//   victim(at)           picks the slot to evict from a full cache
+//   on_erase(at, slot)   `slot` leaves the cache
+//   for_each(at, f)      visits every cached slot, roughly the ones to keep
+//                        longest first (most recent first for LRU)
+// where `at(slot)` returns the meta of a slot and `at.hash(slot)` the hash of
+// its key. `read_only_hits` policies only touch relaxed atomics in on_hit, so
+// lookups may run under a shared lock. A policy is built for one capacity; a
+// resized cache builds a new one and inserts its entries again.
+namespace policy {
+
+// Strict LRU: a hit moves the entry to the front, eviction takes the back.
+class lru : detail::eviction_option {
+public:
+  using meta = detail::slot_links;
+  static constexpr bool read_only_hits = false;
+
+  explicit lru(std::size_t) noexcept {}
+
+  template <typename At> void on_insert(At &&at, const std::uint32_t slot) noexcept { order.push_front(at, slot); }
+  template <typename At> void on_hit(At &&at, const std::uint32_t slot) noexcept { order.move_to_front(at, slot); }
+  template <typename At> std::uint32_t victim(At &&) const noexcept { return order.back(); }
+  template <typename At> void on_erase(At &&at, const std::uint32_t slot) noexcept { order.erase(at, slot); }
+  template <typename At, typename F> void for_each(At &&at, F &&f) const { order.for_each(at, f); }
+
+private:
+  detail::slot_list order;
+};
+
+// CLOCK (second chance): a hit only sets the entry's reference bit, and
+// eviction sweeps a hand around the ring, clearing set bits until it finds an
+// unreferenced entry. Hits never write the ring, and do not even write the bit
+// when it is already set, so concurrent readers do not invalidate each other's
+// cache lines. The bit is a relaxed atomic, which lets ConcurrentCache serve
+// hits under a shared lock.
+class clock : detail::eviction_option {
+public:
+  struct meta : detail::slot_links {
+    std::atomic<bool> referenced;
+  };
+  static constexpr bool read_only_hits = true;
+
+  explicit clock(std::size_t) noexcept {}
+
+  // New entries go just behind the hand: they are the last to be swept
+  template <typename At> void on_insert(At &&at, const std::uint32_t slot) noexcept {
+    auto &m = at(slot);
+    m.referenced.store(false, std::memory_order_relaxed);
+    if (hand == detail::npos) {
+      m.prev = m.next = hand = slot;
+      return;
+    }
+    m.next = hand;
+    m.prev = at(hand).prev;
+    at(m.prev).next = slot;
+    at(hand).prev = slot;
+  }
+
+  template <typename At> void on_hit(At &&at, const std::uint32_t slot) const noexcept {
+    auto &referenced = at(slot).referenced;
+    if (!referenced.load(std::memory_order_relaxed)) {
+      referenced.store(true, std::memory_order_relaxed);
+    }
+  }
+
+  template <typename At> std::uint32_t victim(At &&at) noexcept {
+    while (at(hand).referenced.load(std::memory_order_relaxed)) {
+      at(hand).referenced.store(false, std::memory_order_relaxed);
+      hand = at(hand).next;
+    }
+    return hand;
+  }
+
+  template <typename At> void on_erase(At &&at, const std::uint32_t slot) noexcept {
+    const auto &m = at(slot);
+    if (m.next == slot) {
+      hand = detail::npos;
+      return;
+    }
+    at(m.prev).next = m.next;
+    at(m.next).prev = m.prev;
+    if (hand == slot) {
+      hand = m.next;
+    }
+  }
+
+  // Newest first: from just behind the hand back around to it
+  template <typename At, typename F> void for_each(At &&at, F &&f) const {
+    if (hand == detail::npos) {
+      return;
+    }
+    auto slot = at(hand).prev;
+    for (;;) {
+      const auto prev = at(slot).prev;
+      const auto last = slot == hand;
+      f(slot);
+      if (last) {
+        return;
+      }
+      slot = prev;
+    }
+  }
+
+private:
+  std::uint32_t hand = detail::npos;
+};
+
+// Segmented LRU: new entries go to a probationary segment and are promoted to
+// a protected segment (80% of the capacity) on their second access. Protected
+// overflow is demoted back to probation, and eviction takes the probationary
+// LRU entry first, so one pass over cold keys cannot flush the hot set.
+class slru : detail::eviction_option {
+public:
+  // `window` is only used by w_tinylfu, which runs an slru as its main region
+  enum segment : std::uint8_t { probation, protected_, window };
+
+  struct meta : detail::slot_links {
+    segment in;
+  };
+  static constexpr bool read_only_hits = false;
+
+  explicit slru(const std::size_t capacity) noexcept : protected_capacity{std::max<std::size_t>(capacity * 4 / 5, 1)} {}
+
+  std::size_t size() const noexcept { return probationary.size() + protected_segment.size(); }
+
+  template <typename At> void on_insert(At &&at, const std::uint32_t slot) noexcept {
+    at(slot).in = probation;
+    probationary.push_front(at, slot);
+  }
+
+  template <typename At> void on_hit(At &&at, const std::uint32_t slot) noexcept {
+    if (at(slot).in == protected_) {
+      protected_segment.move_to_front(at, slot);
+      return;
+    }
+    probationary.erase(at, slot);
+    at(slot).in = protected_;
+    protected_segment.push_front(at, slot);
+    if (protected_segment.size() > protected_capacity) {
+      const auto demoted = protected_segment.back();
+      protected_segment.erase(at, demoted);
+      at(demoted).in = probation;
+      probationary.push_front(at, demoted);
+    }
+  }
+
+  template <typename At> std::uint32_t victim(At &&) const noexcept {
+    return probationary.empty() ? protected_segment.back() : probationary.back();
+  }
+
+  template <typename At> void on_erase(At &&at, const std::uint32_t slot) noexcept {
+    (at(slot).in == protected_ ? protected_segment : probationary).erase(at, slot);
+  }
+
+  template <typename At, typename F> void for_each(At &&at, F &&f) const {
+    protected_segment.for_each(at, f);
+    probationary.for_each(at, f);
+  }
+
+private:
+  std::size_t protected_capacity;
+  detail::slot_list probationary;
+  detail::slot_list protected_segment;
+};
+
+// S3-FIFO (Yang et al., SOSP'23): a small FIFO (10% of the capacity) filters
+// one-hit wonders, a main FIFO holds the rest, and a ghost queue remembers the
+// hashes of keys recently evicted from the small queue. Hits only bump a
+// 2-bit relaxed atomic counter, so they are read-only like CLOCK's. Evicting
+// from the small queue promotes entries hit since insertion to the main
+// queue; the main queue reinserts entries with a non-zero counter,
+// decrementing it. Keys found in the ghost queue go straight to main.
+class s3fifo : detail::eviction_option {
+public:
+  struct meta : detail::slot_links {
+    bool in_main;
+    std::atomic<std::uint8_t> frequency;
+  };
+  static constexpr bool read_only_hits = true;
+
+  explicit s3fifo(const std::size_t capacity)
+      : small_capacity{std::max<std::size_t>(capacity / 10, 1)}, ghosts{capacity} {}
+
+  template <typename At> void on_insert(At &&at, const std::uint32_t slot) {
+    auto &m = at(slot);
+    m.frequency.store(0, std::memory_order_relaxed);
+    m.in_main = ghosts.contains(at.hash(slot));
+    (m.in_main ? main : small).push_front(at, slot);
+  }
+
+  template <typename At> void on_hit(At &&at, const std::uint32_t slot) const noexcept {
+    auto &frequency = at(slot).frequency;
+    if (const auto f = frequency.load(std::memory_order_relaxed); f < 3) {
+      frequency.store(f + 1, std::memory_order_relaxed);
+    }
+  }
+
+  template <typename At> std::uint32_t victim(At &&at) {
+    for (;;) {
+      if (!small.empty() && (small.size() >= small_capacity || main.empty())) {
+        const auto slot = small.back();
+        auto &m = at(slot);
+        if (m.frequency.load(std::memory_order_relaxed) == 0) {
+          ghosts.push(at.hash(slot));
+          return slot;
+        }
+        // Accessed while in the small queue: promote
+        small.erase(at, slot);
+        m.frequency.store(0, std::memory_order_relaxed);
+        m.in_main = true;
+        main.push_front(at, slot);
+        continue;
+      }
+      const auto slot = main.back();
+      auto &m = at(slot);
+      const auto f = m.frequency.load(std::memory_order_relaxed);
+      if (f == 0) {
+        return slot;
+      }
+      m.frequency.store(f - 1, std::memory_order_relaxed);
+      main.move_to_front(at, slot);
+    }
+  }
+
+  template <typename At> void on_erase(At &&at, const std::uint32_t slot) noexcept {
+    (at(slot).in_main ? main : small).erase(at, slot);
+  }
+
+  template <typename At, typename F> void for_each(At &&at, F &&f) const {
+    main.for_each(at, f);
+    small.for_each(at, f);
+  }
+
+private:
+  std::size_t small_capacity;
+  detail::slot_list small;
+  detail::slot_list main;
+  detail::ghost_queue ghosts;
+};
+
+// W-TinyLFU (Einziger et al., as in Caffeine): new entries enter a small LRU
+// window (1% of the capacity); the rest is a segmented LRU. When the window
+// overflows into a full main region, its LRU entry is admitted only if the
+// count-min sketch says it is accessed more often than the main region's
+// victim. Every hit and miss is recorded in the sketch.
+class w_tinylfu : detail::eviction_option {
+public:
+  using meta = slru::meta;
+  static constexpr bool read_only_hits = false;
+
+  explicit w_tinylfu(const std::size_t capacity)
+      : window_capacity{std::max<std::size_t>(capacity / 100, 1)},
+        main_capacity{capacity > window_capacity ? capacity - window_capacity : 1}, main{main_capacity},
+        sketch{capacity} {}
+
+  template <typename At> void on_insert(At &&at, const std::uint32_t slot) {
+    sketch.increment(at.hash(slot));
+    at(slot).in = slru::window;
+    window.push_front(at, slot);
+    // While the cache fills up, the window overflows into the main region
+    while (window.size() > window_capacity && main.size() < main_capacity) {
+      const auto moved = window.back();
+      window.erase(at, moved);
+      main.on_insert(at, moved);
+    }
+  }
+
+  template <typename At> void on_hit(At &&at, const std::uint32_t slot) {
+    sketch.increment(at.hash(slot));
+    if (at(slot).in == slru::window) {
+      window.move_to_front(at, slot);
+    } else {
+      main.on_hit(at, slot);
+    }
+  }
+
+  template <typename At> std::uint32_t victim(At &&at) {
+    if (window.empty() || (window.size() < window_capacity && main.size() > 0)) {
+      return main.victim(at);
+    }
+    // The window is about to overflow: its LRU entry competes with the main victim
+    const auto candidate = window.back();
+    if (main.size() == 0) {
+      return candidate;
+    }
+    const auto main_victim = main.victim(at);
+    if (sketch.estimate(at.hash(candidate)) <= sketch.estimate(at.hash(main_victim))) {
+      return candidate;
+    }
+    window.erase(at, candidate);
+    main.on_insert(at, candidate);
+    return main_victim;
+  }
+
+  template <typename At> void on_erase(At &&at, const std::uint32_t slot) noexcept {
+    if (at(slot).in == slru::window) {
+      window.erase(at, slot);
+    } else {
+      main.on_erase(at, slot);
+    }
+  }
+
+  template <typename At, typename F> void for_each(At &&at, F &&f) const {
+    window.for_each(at, f);
+    main.for_each(at, f);
+  }
+
+private:
+  std::size_t window_capacity;
+  std::size_t main_capacity;
+  detail::slot_list window;
+  slru main;
+  detail::frequency_sketch sketch;
+};
+
+} // namespace policy
+
+namespace detail {
+
+template <typename T> struct type_identity {
+  using type = T;
+};
+
+// The first of `Options` deriving from `Tag`, or `Default`
+template <typename Tag, typename Default, typename... Options> struct select_option : type_identity<Default> {};
+
+template <typename Tag, typename Default, typename Option, typename... Options>
+struct select_option<Tag, Default, Option, Options...>
+    : std::conditional_t<std::is_base_of_v<Tag, Option>, type_identity<Option>,
+                         select_option<Tag, Default, Options...>> {};
+
+template <typename Tag, typename Default, typename... Options>
+using select_option_t = typename select_option<Tag, Default, Options...>::type;
+
+// Whether the flag option `Flag` is among `Options`
+template <typename Flag, typename... Options>
+inline constexpr bool has_option_v = (std::is_same_v<Flag, Options> || ...);
+
+} // namespace detail
+
+} // namespace lru
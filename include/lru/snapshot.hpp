@@ -0,0 +1,182 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace lru {
+
+namespace detail {
+
+// Whether a T is snapshotted as its raw bytes, and can be rebuilt from them
+template <typename T>
+inline constexpr bool flat_v = std::is_trivially_copyable_v<T> && std::is_default_constructible_v<T>;
+
+// Header of a cache snapshot, see BasicCache::save. Its fields and flat
+// records are in the byte order of the machine that wrote them: a snapshot
+// is meant to warm up the next process of the same build.
+struct snapshot_header {
+  static constexpr char signature[8] = {'L', 'R', 'U', 'S', 'N', 'A', 'P', '1'};
+
+  char magic[8];
+  // 1 when the records are the raw bytes of the key fields and the value,
+  // back to back; 0 when they were written by a serializer
+  std::uint32_t flat;
+  std::uint32_t reserved;
+  std::uint64_t capacity;
+  std::uint64_t count;
+  // Flat records: bytes of the key fields, and of the value
+  std::uint64_t key_bytes;
+  std::uint64_t value_bytes;
+};
+
+// A file's bytes, read-only: memory-mapped where the platform has mmap, read
+// into memory otherwise
+class mapped_file {
+public:
+  explicit mapped_file(const std::string &path) {
+#if defined(__unix__) || defined(__APPLE__)
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("lru: cannot open " + path);
+    }
+    struct stat status {};
+    if (::fstat(fd, &status) != 0) {
+      ::close(fd);
+      throw std::runtime_error("lru: cannot read " + path);
+    }
+    length = static_cast<std::size_t>(status.st_size);
+    if (length > 0) {
+      void *mapping = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapping == MAP_FAILED) {
+        ::close(fd);
+        throw std::runtime_error("lru: cannot map " + path);
+      }
+      bytes = static_cast<const char *>(mapping);
+      // One sequential pass follows
+      ::madvise(mapping, length, MADV_SEQUENTIAL);
+    }
+    ::close(fd);
+#else
+    std::ifstream file{path, std::ios::binary | std::ios::ate};
+    if (!file) {
+      throw std::runtime_error("lru: cannot open " + path);
+    }
+    length = static_cast<std::size_t>(file.tellg());
+    buffer.reset(new char[length]);
+    file.seekg(0);
+    if (!file.read(buffer.get(), static_cast<std::streamsize>(length))) {
+      throw std::runtime_error("lru: cannot read " + path);
+    }
+    bytes = buffer.get();
+#endif
+  }
+
+  ~mapped_file() {
+#if defined(__unix__) || defined(__APPLE__)
+    if (length > 0) {
+      ::munmap(const_cast<char *>(bytes), length);
+    }
+#endif
+  }
+
+  mapped_file(mapped_file const &) = delete;
+  mapped_file &operator=(mapped_file const &) = delete;
+
+  const char *data() const noexcept { return bytes; }
+  std::size_t size() const noexcept { return length; }
+
+private:
+  const char *bytes = nullptr;
+  std::size_t length = 0;
+#if !(defined(__unix__) || defined(__APPLE__))
+  std::unique_ptr<char[]> buffer;
+#endif
+};
+
+// Writes a snapshot next to `path` and renames it over `path` once complete,
+// so a crash mid-save leaves the previous snapshot intact
+class snapshot_file {
+public:
+  explicit snapshot_file(std::string path)
+      : path{std::move(path)}, staging{this->path + ".tmp"}, out{staging, std::ios::binary | std::ios::trunc} {
+    if (!out) {
+      throw std::runtime_error("lru: cannot create " + staging);
+    }
+  }
+
+  std::ostream &stream() noexcept { return out; }
+
+  void write(const void *data, const std::size_t size) {
+    out.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+  }
+
+  void commit() {
+    out.close();
+    if (!out) {
+      throw std::runtime_error("lru: cannot write " + staging);
+    }
+    std::filesystem::rename(staging, path);
+    committed = true;
+  }
+
+  ~snapshot_file() {
+    if (!committed) {
+      out.close();
+      std::error_code ignored;
+      std::filesystem::remove(staging, ignored);
+    }
+  }
+
+private:
+  const std::string path;
+  const std::string staging;
+  std::ofstream out;
+  bool committed = false;
+};
+
+// Checks the header at the start of `file` against the cache reading it
+inline snapshot_header read_snapshot_header(mapped_file const &file, const bool flat, const std::size_t key_bytes,
+                                            const std::size_t value_bytes) {
+  snapshot_header header;
+  if (file.size() < sizeof(header)) {
+    throw std::runtime_error("lru: not a cache snapshot");
+  }
+  std::memcpy(&header, file.data(), sizeof(header));
+  if (std::memcmp(header.magic, snapshot_header::signature, sizeof(header.magic)) != 0) {
+    throw std::runtime_error("lru: not a cache snapshot");
+  }
+  if (header.flat != flat || (flat && (header.key_bytes != key_bytes || header.value_bytes != value_bytes ||
+                                       file.size() - sizeof(header) < header.count * (key_bytes + value_bytes)))) {
+    throw std::runtime_error("lru: snapshot does not match the cache's key and value types");
+  }
+  return header;
+}
+
+// Reads the serialized records that follow the header, from the mapping
+class snapshot_source : public std::streambuf {
+public:
+  explicit snapshot_source(mapped_file const &file) {
+    auto *begin = const_cast<char *>(file.data()) + sizeof(snapshot_header);
+    setg(begin, begin, const_cast<char *>(file.data()) + file.size());
+  }
+};
+
+} // namespace detail
+
+} // namespace lru
@@ -0,0 +1,257 @@
+#pragma once
+
+#include "lru.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace lru {
+
+namespace detail {
+
+template <auto Fn> struct function_traits<function_constant<Fn>> : function_traits<decltype(Fn)> {};
+
+} // namespace detail
+
+template <std::size_t N, typename Signature, typename F> class BasicStaticCache;
+
+// Strict LRU memoizer of at most N entries, all stored inline: no heap
+// allocation, no hash table and no type erasure, so a small cache can be a
+// member of the object it serves. `func` is stored by value.
+//
+// A lookup compares a 32 bit tag of the key's hash with every stored tag, 64
+// tags at a time into a bit mask in a loop that compilers vectorize, and
+// compares keys only where tags match. A hit stamps its entry; a miss in a
+// full cache replaces the entry with the oldest stamp. Both are O(N), which
+// beats hashing into a table while N is a few dozen; larger caches want
+// BasicCache. Not thread-safe.
+template <std::size_t N, typename R, typename... Args, typename F> class BasicStaticCache<N, R(Args...), F> {
+  static_assert(N > 0, "lru::StaticCache needs room for one entry");
+  static_assert(N < std::numeric_limits<std::uint32_t>::max(), "lru::StaticCache capacity must fit in 32 bits");
+
+public:
+  using Function = F;
+  using Key = std::tuple<std::decay_t<Args>...>;
+  using MapHash = detail::tuple_hash<Key>;
+
+  explicit BasicStaticCache(Function func = Function{}) : func{std::move(func)} {}
+
+  BasicStaticCache(BasicStaticCache const &other) : func{other.func} {
+    copy_entries(other, [](Entry const &entry) -> Entry const & { return entry; });
+  }
+
+  BasicStaticCache(BasicStaticCache &&other) noexcept(std::is_nothrow_move_constructible_v<Entry> &&
+                                                      std::is_nothrow_move_constructible_v<Function>)
+      : func{std::move(other.func)} {
+    copy_entries(other, [](Entry &entry) -> Entry && { return std::move(entry); });
+  }
+
+  // Functions, lambdas among them, need not be assignable
+  BasicStaticCache &operator=(BasicStaticCache const &) = delete;
+  BasicStaticCache &operator=(BasicStaticCache &&) = delete;
+
+  ~BasicStaticCache() { clear(); }
+
+  static constexpr std::size_t capacity() noexcept { return N; }
+  std::size_t size() const noexcept { return count; }
+
+  R operator()(Args... args) { return get(std::forward<Args>(args)...); }
+
+  // See BasicCache: string arguments may be passed as string views
+  template <typename... Ts, typename = std::enable_if_t<detail::heterogeneous_call<Key, std::tuple<Ts...>>::value>>
+  R operator()(Ts const &...ts) {
+    return get(ts...);
+  }
+
+  // Like operator(), but returns the cached value itself. The reference is
+  // valid until the next call on the cache, which may evict the entry.
+  R const &get(Args... args) {
+    const std::tuple<std::decay_t<Args> const &...> probe{args...};
+    return get_or_compute(probe, [&] { return Entry{Key{args...}, func(std::forward<Args>(args)...)}; });
+  }
+
+  template <typename... Ts, typename = std::enable_if_t<detail::heterogeneous_call<Key, std::tuple<Ts...>>::value>>
+  R const &get(Ts const &...ts) {
+    const std::tuple<detail::probe_element_t<std::decay_t<Args>, Ts>...> probe{ts...};
+    return get_or_compute(probe, [&] {
+      Key key{std::decay_t<Args>(ts)...};
+      R val = std::apply(func, std::as_const(key));
+      return Entry{std::move(key), std::move(val)};
+    });
+  }
+
+  // Whether the arguments are cached, without touching their entry
+  bool contains(std::decay_t<Args> const &...args) const {
+    const std::tuple<std::decay_t<Args> const &...> probe{args...};
+    return find(probe, tag_of(MapHash{}(probe))) != npos;
+  }
+
+  void clear() noexcept {
+    for (std::uint32_t i = 0; i < count; ++i) {
+      slots[i].entry.~Entry();
+    }
+    count = 0;
+  }
+
+private:
+  using Entry = std::pair<Key, R>;
+
+  static constexpr std::uint32_t npos = std::numeric_limits<std::uint32_t>::max();
+  // Tags compared into one mask
+  static constexpr std::size_t width = std::min<std::size_t>(N, 64);
+  static constexpr std::size_t blocks = (N + width - 1) / width;
+
+  // Holds an entry while its index is below `count`
+  union Slot {
+    Slot() noexcept {}
+    ~Slot() {}
+    Entry entry;
+  };
+
+  static std::uint32_t tag_of(const std::size_t hash) noexcept {
+    return static_cast<std::uint32_t>(hash ^ (static_cast<std::uint64_t>(hash) >> 32));
+  }
+
+  template <typename Probe, typename Compute> R const &get_or_compute(Probe const &probe, Compute &&compute) {
+    const auto tag = tag_of(MapHash{}(probe));
+    if (const auto slot = find(probe, tag); slot != npos) {
+      touch(slot);
+      return slots[slot].entry.second;
+    }
+
+    // Computed before anything changes, so a throwing `func` leaves the cache
+    // as it was
+    Entry entry = compute();
+    std::uint32_t slot;
+    if (count < N) {
+      slot = count++;
+    } else {
+      slot = oldest();
+      slots[slot].entry.~Entry();
+    }
+    try {
+      new (&slots[slot].entry) Entry{std::move(entry)};
+    } catch (...) {
+      // Keep the slots below `count` full. Moving the last entry into the
+      // hole could throw like the move that just did, so the entries after
+      // the hole are dropped instead.
+      if (slot != --count) {
+        for (auto i = slot + 1; i <= count; ++i) {
+          slots[i].entry.~Entry();
+        }
+        count = slot;
+      }
+      throw;
+    }
+    tags[slot] = tag;
+    touch(slot);
+    return slots[slot].entry.second;
+  }
+
+  // The slot whose key equals `probe`, or npos
+  template <typename Probe> std::uint32_t find(Probe const &probe, const std::uint32_t tag) const {
+    for (std::size_t base = 0; base < count; base += width) {
+      std::uint64_t matches = 0;
+      for (std::size_t i = 0; i < width; ++i) {
+        matches |= std::uint64_t{tags[base + i] == tag} << i;
+      }
+      // Drop the tags of empty slots
+      if (const auto used = count - base; used < width) {
+        matches &= (std::uint64_t{1} << used) - 1;
+      }
+      for (; matches; matches &= matches - 1) {
+        const auto slot = static_cast<std::uint32_t>(base + detail::lowest_bit(matches));
+        if (detail::tuple_equal<Key>{}(slots[slot].entry.first, probe)) {
+          return slot;
+        }
+      }
+    }
+    return npos;
+  }
+
+  // The least recently used slot of a full cache
+  std::uint32_t oldest() const noexcept {
+    std::uint32_t slot = 0;
+    for (std::uint32_t i = 1; i < N; ++i) {
+      if (stamps[i] < stamps[slot]) {
+        slot = i;
+      }
+    }
+    return slot;
+  }
+
+  void touch(const std::uint32_t slot) noexcept {
+    if (++clock == 0) {
+      renumber();
+    }
+    stamps[slot] = clock;
+  }
+
+  // When the clock wraps, restamps the entries 1..count in the same order.
+  // Stamps are distinct, so an entry's new stamp is its rank; quadratic, but
+  // once every 2^32 calls.
+  void renumber() noexcept {
+    std::array<std::uint32_t, N> ranks{};
+    for (std::uint32_t i = 0; i < count; ++i) {
+      for (std::uint32_t j = 0; j < count; ++j) {
+        ranks[i] += stamps[j] <= stamps[i];
+      }
+    }
+    std::copy(ranks.begin(), ranks.begin() + count, stamps.begin());
+    clock = count + 1;
+  }
+
+  // Builds the entries of `other`, as `pass` (a copy or a move) gives them;
+  // if one throws, those already built are destroyed
+  template <typename Other, typename Pass> void copy_entries(Other &other, Pass pass) {
+    try {
+      for (; count < other.count; ++count) {
+        new (&slots[count].entry) Entry{pass(other.slots[count].entry)};
+      }
+    } catch (...) {
+      clear();
+      throw;
+    }
+    copy_order(other);
+  }
+
+  void copy_order(BasicStaticCache const &other) noexcept {
+    tags = other.tags;
+    stamps = other.stamps;
+    clock = other.clock;
+  }
+
+  // Padded to whole blocks so the scan never reads past the array; tags of
+  // empty slots are masked out
+  std::array<std::uint32_t, blocks * width> tags{};
+  // Last use of each entry, on `clock`
+  std::array<std::uint32_t, N> stamps{};
+  std::uint32_t count = 0;
+  std::uint32_t clock = 0;
+  std::array<Slot, N> slots;
+  Function func;
+};
+
+// The static cache of the function object (pointer) type F
+template <std::size_t N, typename F>
+using StaticCache = BasicStaticCache<N, typename detail::function_traits<F>::signature, F>;
+
+// `f` is stored by value, like make_cache
+template <std::size_t N, typename F> auto make_static_cache(F &&f) {
+  return StaticCache<N, std::decay_t<F>>(std::forward<F>(f));
+}
+
+// Calls the function `Fn` known at compile time: the cache stores nothing for it
+template <std::size_t N, auto Fn, typename = std::enable_if_t<!std::is_member_function_pointer_v<decltype(Fn)>>>
+auto make_static_cache() {
+  return StaticCache<N, detail::function_constant<Fn>>{};
+}
+
+} // namespace lru
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace lru {
+
+// Log-linear histogram of durations in nanoseconds: exact below 4ns, then
+// four buckets per power of two, so any bucket is at most 25% wide. The last
+// bucket also takes everything from 2^40ns (about 18 minutes) up.
+class latency_histogram {
+public:
+  static constexpr std::size_t bucket_count = 4 + 4 * 39;
+
+  void record(const std::uint64_t nanos) noexcept {
+    ++counts[bucket_of(nanos)];
+    ++samples;
+    total += nanos;
+  }
+
+  std::uint64_t count() const noexcept { return samples; }
+  std::uint64_t count(const std::size_t bucket) const noexcept { return counts[bucket]; }
+
+  // Mean of the recorded durations, 0 without samples
+  double mean() const noexcept { return samples ? double(total) / double(samples) : 0.0; }
+
+  // Smallest duration that falls in `bucket`
+  static std::uint64_t lower_bound(const std::size_t bucket) noexcept {
+    if (bucket < 4) {
+      return bucket;
+    }
+    const auto exponent = (bucket - 4) / 4 + 2;
+    const auto mantissa = (bucket - 4) % 4;
+    return (std::uint64_t{4} | mantissa) << (exponent - 2);
+  }
+
+  // Upper bound of the bucket holding the `quantile` (in [0, 1]) of the
+  // samples, 0 without samples
+  std::uint64_t percentile(const double quantile) const noexcept {
+    if (samples == 0) {
+      return 0;
+    }
+    const auto rank = static_cast<std::uint64_t>(std::clamp(quantile, 0.0, 1.0) * double(samples - 1));
+    std::uint64_t seen = 0;
+    for (std::size_t bucket = 0; bucket < bucket_count; ++bucket) {
+      seen += counts[bucket];
+      if (seen > rank) {
+        return bucket + 1 < bucket_count ? lower_bound(bucket + 1) - 1 : lower_bound(bucket);
+      }
+    }
+    return lower_bound(bucket_count - 1);
+  }
+
+  latency_histogram &operator+=(latency_histogram const &other) noexcept {
+    for (std::size_t bucket = 0; bucket < bucket_count; ++bucket) {
+      counts[bucket] += other.counts[bucket];
+    }
+    samples += other.samples;
+    total += other.total;
+    return *this;
+  }
+
+private:
+  static std::size_t bucket_of(const std::uint64_t nanos) noexcept {
+    if (nanos < 4) {
+      return static_cast<std::size_t>(nanos);
+    }
+    unsigned exponent = 63;
+    while (!(nanos >> exponent)) {
+      --exponent;
+    }
+    if (exponent > 40) {
+      return bucket_count - 1;
+    }
+    const auto mantissa = (nanos >> (exponent - 2)) & 3;
+    return std::min<std::size_t>(4 + (exponent - 2) * 4 + mantissa, bucket_count - 1);
+  }
+
+  std::uint64_t counts[bucket_count] = {};
+  std::uint64_t samples = 0;
+  std::uint64_t total = 0;
+};
+
+// Snapshot of an instrumented cache, see lru::instrumented
+struct cache_stats {
+  std::uint64_t hits = 0;
+  std::uint64_t misses = 0;
+  // Entries stored, and removed for any reason: evicted by the policy,
+  // expired, or otherwise erased
+  std::uint64_t inserts = 0;
+  std::uint64_t erases = 0;
+  std::uint64_t evictions = 0;
+  std::uint64_t expirations = 0;
+  std::size_t size = 0;
+  std::size_t capacity = 0;
+  std::size_t weight = 0;
+  // Heap and object bytes of the cache's own structures; memory owned by
+  // keys and values is not included (a weigher can account for it)
+  std::size_t memory_bytes = 0;
+  // Time spent computing missing values
+  latency_histogram miss_latency;
+
+  double hit_ratio() const noexcept {
+    const auto lookups = hits + misses;
+    return lookups ? double(hits) / double(lookups) : 0.0;
+  }
+
+  // Adds up the stats of the shards of a cache
+  cache_stats &operator+=(cache_stats const &other) noexcept {
+    hits += other.hits;
+    misses += other.misses;
+    inserts += other.inserts;
+    erases += other.erases;
+    evictions += other.evictions;
+    expirations += other.expirations;
+    size += other.size;
+    capacity += other.capacity;
+    weight += other.weight;
+    memory_bytes += other.memory_bytes;
+    miss_latency += other.miss_latency;
+    return *this;
+  }
+};
+
+namespace detail {
+
+// Tag base of the stats options, see select_option
+struct stats_option {};
+
+// Default stats option: nothing is counted, and nothing is stored for it
+struct no_stats : stats_option {
+  static constexpr bool enabled = false;
+  using clock = std::chrono::steady_clock;
+};
+
+// Counters of an instrumented BasicCache, which derives from them so that
+// the disabled ones take no space
+template <bool Enabled> struct stat_counters {};
+
+template <> struct stat_counters<true> {
+  std::uint64_t hits = 0;
+  std::uint64_t misses = 0;
+  std::uint64_t inserts = 0;
+  std::uint64_t erases = 0;
+  std::uint64_t evictions = 0;
+  std::uint64_t expirations = 0;
+  latency_histogram miss_latency;
+};
+
+} // namespace detail
+
+// Cache option: count hits, misses, insertions and removals, and time the
+// function on every miss with `Clock`; read them with stats(). Without it
+// none of this is compiled in.
+template <typename Clock = std::chrono::steady_clock> struct instrumented : detail::stats_option {
+  static constexpr bool enabled = true;
+  using clock = Clock;
+};
+
+} // namespace lru
@@ -0,0 +1,261 @@
+#pragma once
+
+#include "concurrent.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+namespace lru {
+
+namespace detail {
+
+// Identifies a tiered cache to the threads' tier tables; never reused, so a
+// table entry left by a destroyed cache is never looked up again
+inline std::uint64_t next_tiered_id() noexcept {
+  static std::atomic<std::uint64_t> next{1};
+  return next.fetch_add(1, std::memory_order_relaxed);
+}
+
+} // namespace detail
+
+template <typename Signature, typename... Options> class BasicTieredCache;
+
+// Two-tier memoizer: every thread reads through its own small strict-LRU
+// cache (L1), which takes no lock and shares no cache line with other
+// threads, in front of a shared BasicConcurrentCache (L2) that computes the
+// misses. A thread copies a value from L2 into its L1 once it has asked L2
+// for the key `promote_after` times (as estimated by a frequency sketch), so
+// only its hot keys take L1 room.
+//
+// invalidate(args...) drops the key from L2 and appends it to a log that
+// every L1 replays before its thread's next lookup; a thread that fell more
+// than `invalidation_log` invalidations behind empties its L1 instead. A
+// lookup that starts after invalidate returns never sees the old value from
+// L1 (it may from L2, if a miss started before the invalidation lands after
+// it). Without invalidations, the only shared access of an L1 hit is the
+// read of the log position.
+//
+// A thread's L1 is created on its first lookup and freed when the thread
+// exits or the cache is destroyed, whichever comes first. Accepts the BasicConcurrentCache options, which apply to L2, except
+// lru::expiring, as L1 copies would outlive their time-to-live, and
+// lru::fingerprinted.
+template <typename R, typename... Args, typename... Options> class BasicTieredCache<R(Args...), Options...> {
+  static_assert(!detail::select_option_t<detail::expiry_option, detail::no_expiry, Options...>::enabled,
+                "lru::TieredCache does not support lru::expiring");
+  static_assert(!detail::has_option_v<fingerprinted, Options...>,
+                "lru::TieredCache does not support lru::fingerprinted");
+
+public:
+  using Shared = BasicConcurrentCache<R(Args...), Options...>;
+  using Function = typename Shared::Function;
+  using Key = typename Shared::Key;
+  using MapHash = typename Shared::MapHash;
+
+  // Invalidations an L1 can fall behind by and still replay them one by one
+  static constexpr std::size_t invalidation_log = 256;
+
+  explicit BasicTieredCache(Function func, std::size_t capacity = 1024, std::size_t thread_capacity = 64,
+                            unsigned promote_after = 1)
+      : thread_entries{checked_thread_capacity(thread_capacity)},
+        promotion{checked_promotion(promote_after)}, shared_cache{std::move(func), capacity} {}
+
+  BasicTieredCache(BasicTieredCache const &) = delete;
+  BasicTieredCache &operator=(BasicTieredCache const &) = delete;
+
+  R operator()(Args... args) {
+    auto &tier = local();
+    catch_up(tier);
+    const std::tuple<std::decay_t<Args> const &...> probe{args...};
+    const auto hash = MapHash{}(probe);
+    if (const auto *hit = tier.cache.find(probe, hash)) {
+      return *hit;
+    }
+    R val = shared_cache(args...);
+    if (promote(tier, hash)) {
+      tier.cache.insert(Key{args...}, hash, R{val});
+    }
+    return val;
+  }
+
+  // Drops the key from L2, and from every L1 before its thread's next
+  // lookup. Returns whether L2 held it.
+  bool invalidate(Args... args) {
+    Key key{args...};
+    const auto hash = MapHash{}(key);
+    const bool erased = shared_cache.erase(args...);
+    std::lock_guard<std::mutex> lock{log_mutex};
+    const auto position = invalidations.load(std::memory_order_relaxed);
+    log[position % invalidation_log].emplace(std::move(key), hash);
+    invalidations.store(position + 1, std::memory_order_release);
+    return erased;
+  }
+
+  // Empties L2, and every L1 before its thread's next lookup
+  void clear() {
+    shared_cache.clear();
+    std::lock_guard<std::mutex> lock{log_mutex};
+    // Puts every L1 more than a full log behind
+    invalidations.store(invalidations.load(std::memory_order_relaxed) + invalidation_log + 1,
+                        std::memory_order_release);
+  }
+
+  std::size_t thread_capacity() const noexcept { return thread_entries; }
+
+  // Threads holding an L1: those that looked a key up and have not exited
+  std::size_t thread_tiers() const {
+    std::lock_guard<std::mutex> lock{registry->mutex};
+    return registry->tiers.size();
+  }
+
+  // L2, e.g. for its stats with lru::instrumented
+  Shared &shared() noexcept { return shared_cache; }
+
+private:
+  using LocalCache = BasicCache<R(Args...), callable<detail::no_function>>;
+
+  // One thread's L1
+  struct Tier {
+    Tier(const std::size_t capacity, const unsigned promote_after, const std::uint64_t synced)
+        : cache{{}, capacity}, synced{synced} {
+      if (promote_after > 1) {
+        sketch = std::make_unique<detail::frequency_sketch>(16 * capacity);
+      }
+    }
+
+    LocalCache cache;
+    // L2 requests per key, only when promotion waits for more than one
+    std::unique_ptr<detail::frequency_sketch> sketch;
+    // Invalidations replayed so far
+    std::uint64_t synced;
+  };
+
+  struct Registry {
+    std::mutex mutex;
+    std::unordered_map<Tier const *, std::unique_ptr<Tier>> tiers;
+  };
+
+  static std::size_t checked_thread_capacity(const std::size_t capacity) {
+    if (capacity == 0 || capacity >= detail::npos) {
+      throw std::length_error("lru::TieredCache thread capacity must be in [1, 2^32 - 1)");
+    }
+    return capacity;
+  }
+
+  static unsigned checked_promotion(const unsigned promote_after) {
+    if (promote_after == 0 || promote_after > 15) {
+      throw std::invalid_argument("lru::TieredCache promote_after must be in [1, 15]");
+    }
+    return promote_after;
+  }
+
+  // The calling thread's L1, created on its first lookup. The thread's table
+  // holds its tiers through weak_ptrs: at thread exit it hands back the tiers
+  // of the caches still alive, and it drops the entries of destroyed caches
+  // whenever the thread creates a tier.
+  Tier &local() {
+    struct Entry {
+      std::weak_ptr<Registry> registry;
+      Tier *tier;
+    };
+    struct Tiers {
+      std::uint64_t last_id = 0;
+      Tier *last = nullptr;
+      std::unordered_map<std::uint64_t, Entry> by_id;
+
+      ~Tiers() {
+        for (auto &[id, entry] : by_id) {
+          if (auto registry = entry.registry.lock()) {
+            std::lock_guard<std::mutex> lock{registry->mutex};
+            registry->tiers.erase(entry.tier);
+          }
+        }
+      }
+    };
+    thread_local Tiers tiers;
+    if (tiers.last_id == id) {
+      return *tiers.last;
+    }
+    auto found = tiers.by_id.find(id);
+    if (found == tiers.by_id.end()) {
+      for (auto it = tiers.by_id.begin(); it != tiers.by_id.end();) {
+        if (it->second.registry.expired()) {
+          it = tiers.by_id.erase(it);
+        } else {
+          ++it;
+        }
+      }
+      auto created = std::make_unique<Tier>(thread_entries, promotion, invalidations.load(std::memory_order_acquire));
+      auto *tier = created.get();
+      found = tiers.by_id.emplace(id, Entry{registry, tier}).first;
+      std::lock_guard<std::mutex> lock{registry->mutex};
+      registry->tiers.emplace(tier, std::move(created));
+    }
+    tiers.last_id = id;
+    tiers.last = found->second.tier;
+    return *tiers.last;
+  }
+
+  // Replays the invalidations `tier` has not seen yet
+  void catch_up(Tier &tier) {
+    if (tier.synced == invalidations.load(std::memory_order_acquire)) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock{log_mutex};
+    const auto latest = invalidations.load(std::memory_order_relaxed);
+    if (latest - tier.synced > invalidation_log) {
+      tier.cache.clear();
+    } else {
+      for (auto position = tier.synced; position != latest; ++position) {
+        auto const &[key, hash] = *log[position % invalidation_log];
+        tier.cache.erase(key, hash);
+      }
+    }
+    tier.synced = latest;
+  }
+
+  bool promote(Tier &tier, const std::size_t hash) const noexcept {
+    if (!tier.sketch) {
+      return true;
+    }
+    tier.sketch->increment(hash);
+    return tier.sketch->estimate(hash) >= promotion;
+  }
+
+  const std::uint64_t id = detail::next_tiered_id();
+  const std::size_t thread_entries;
+  const unsigned promotion;
+  Shared shared_cache;
+
+  // Invalidations so far; the last `invalidation_log` are in `log`
+  alignas(64) std::atomic<std::uint64_t> invalidations{0};
+  std::mutex log_mutex;
+  std::optional<std::pair<Key, std::size_t>> log[invalidation_log];
+
+  // The threads' L1s, shared with their tables so that a thread exiting
+  // after the cache is destroyed finds it gone
+  const std::shared_ptr<Registry> registry = std::make_shared<Registry>();
+};
+
+// The default tiered cache: strict LRU in both tiers
+template <typename R, typename... Args> using TieredCache = BasicTieredCache<R(Args...)>;
+
+// `Options` are forwarded to BasicTieredCache and `f` is stored by value,
+// like make_cache
+template <typename... Options, typename F>
+auto make_tiered_cache(F &&f, std::size_t capacity = 1024, std::size_t thread_capacity = 64,
+                       unsigned promote_after = 1) {
+  using Signature = typename detail::function_traits<std::decay_t<F>>::signature;
+  return BasicTieredCache<Signature, callable<std::decay_t<F>>, Options...>(std::forward<F>(f), capacity,
+                                                                             thread_capacity, promote_after);
+}
+
+} // namespace lru
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+namespace lru {
+
+// Trace files hold the key hashes a cache looked up, in order: the 8-byte
+// magic "LRUTRACE", then one little-endian 64-bit hash per lookup. Hashes
+// are as random as their bits, so packing them any tighter would not pay.
+inline constexpr char trace_magic[8] = {'L', 'R', 'U', 'T', 'R', 'A', 'C', 'E'};
+
+// Appends hashes to a trace file through a buffer; the file is complete once
+// the writer is flushed or destroyed
+class trace_writer {
+public:
+  explicit trace_writer(const std::string &path) : file{path, std::ios::binary | std::ios::trunc} {
+    if (!file) {
+      throw std::runtime_error("lru::trace_writer cannot open " + path);
+    }
+    file.write(trace_magic, sizeof(trace_magic));
+  }
+
+  ~trace_writer() {
+    file.write(buffer, static_cast<std::streamsize>(buffered));
+  }
+
+  trace_writer(trace_writer const &) = delete;
+  trace_writer &operator=(trace_writer const &) = delete;
+
+  void append(const std::uint64_t hash) {
+    for (unsigned byte = 0; byte < 8; ++byte) {
+      buffer[buffered + byte] = static_cast<char>(hash >> (8 * byte));
+    }
+    buffered += 8;
+    ++count;
+    if (buffered == sizeof(buffer)) {
+      flush();
+    }
+  }
+
+  void flush() {
+    file.write(buffer, static_cast<std::streamsize>(buffered));
+    file.flush();
+    buffered = 0;
+    if (!file) {
+      throw std::runtime_error("lru::trace_writer failed to write");
+    }
+  }
+
+  // Hashes appended so far
+  std::uint64_t size() const noexcept { return count; }
+
+private:
+  std::ofstream file;
+  char buffer[1 << 16];
+  std::size_t buffered = 0;
+  std::uint64_t count = 0;
+};
+
+// Reads back the hashes of a trace file
+class trace_reader {
+public:
+  explicit trace_reader(const std::string &path) : file{path, std::ios::binary | std::ios::ate} {
+    if (!file) {
+      throw std::runtime_error("lru::trace_reader cannot open " + path);
+    }
+    const auto bytes = static_cast<std::uint64_t>(file.tellg());
+    file.seekg(0);
+    char magic[sizeof(trace_magic)] = {};
+    file.read(magic, sizeof(magic));
+    if (!file || std::char_traits<char>::compare(magic, trace_magic, sizeof(magic)) != 0) {
+      throw std::runtime_error(path + " is not an lru trace");
+    }
+    records = (bytes - sizeof(magic)) / 8;
+  }
+
+  // Number of hashes in the file
+  std::uint64_t size() const noexcept { return records; }
+
+  // Reads up to `max` of the next hashes into `out`; returns how many, 0 at
+  // the end of the trace
+  std::size_t read(std::uint64_t *out, const std::size_t max) {
+    file.read(reinterpret_cast<char *>(out), static_cast<std::streamsize>(max * 8));
+    // A truncated last hash is dropped
+    const auto done = static_cast<std::size_t>(file.gcount()) / 8;
+    for (std::size_t i = 0; i < done; ++i) {
+      unsigned char bytes[8];
+      std::memcpy(bytes, &out[i], sizeof(bytes));
+      std::uint64_t hash = 0;
+      for (unsigned byte = 0; byte < 8; ++byte) {
+        hash |= std::uint64_t{bytes[byte]} << (8 * byte);
+      }
+      out[i] = hash;
+    }
+    return done;
+  }
+
+private:
+  std::ifstream file;
+  std::uint64_t records;
+};
+
+namespace detail {
+
+// Trace writer of a traced BasicCache, which derives from it so that other
+// caches do not store it
+template <bool Enabled> struct trace_sink {};
+
+template <> struct trace_sink<true> {
+  trace_writer *recorder = nullptr;
+};
+
+} // namespace detail
+
+// Cache option: log the hash of every key looked up (operator(), get and
+// get_many) to the trace_writer given to BasicCache::record_to, for offline
+// replay (see benchmarks/replay.cpp). Without it none of this is compiled in.
+struct traced {};
+
+} // namespace lru
@@ -0,0 +1,84 @@
+#include "lru/lru.hpp"
+#include "lru/static_cache.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <gtest/gtest.h>
+#include <new>
+#include <string>
+#include <string_view>
+
+namespace {
+std::atomic<std::size_t> allocations{0};
+}
+
+void *operator new(std::size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc{};
+}
+
+// std::pmr::new_delete_resource goes through the aligned overloads
+void *operator new(std::size_t size, std::align_val_t align) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  const auto alignment = std::max(static_cast<std::size_t>(align), sizeof(void *));
+  if (void *p = std::aligned_alloc(alignment, (std::max<std::size_t>(size, 1) + alignment - 1) / alignment * alignment)) {
+    return p;
+  }
+  throw std::bad_alloc{};
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+int square(const int x) { return x * x; }
+
+TEST(LRUCacheAllocationTest, MissesAndEvictionsDoNotAllocate) {
+  auto cache = lru::make_cache(square, 64);
+
+  // Fill the cache and force a round of evictions
+  for (int i = 0; i < 2 * int(cache.capacity()); ++i) {
+    cache(i);
+  }
+
+  const auto before = allocations.load();
+  for (int round = 0; round < 16; ++round) {
+    for (int i = 0; i < 4 * int(cache.capacity()); ++i) {
+      EXPECT_EQ(cache(i), square(i)); // misses and evictions
+      EXPECT_EQ(cache(i), square(i)); // hits
+    }
+  }
+  EXPECT_EQ(allocations.load() - before, 0u);
+}
+
+std::size_t length(const std::string &s, const int salt) { return s.size() + salt; }
+
+TEST(LRUCacheAllocationTest, StringHitsDoNotAllocate) {
+  auto cache = lru::make_cache(length, 64);
+  const std::string name = "a key that is too long for the small string buffer";
+  const std::string_view view = name;
+  cache(name, 1);
+
+  const auto before = allocations.load();
+  for (int round = 0; round < 16; ++round) {
+    EXPECT_EQ(cache(name, 1), name.size() + 1);
+    EXPECT_EQ(cache(view, 1), name.size() + 1);
+    EXPECT_EQ(cache("a key that is too long for the small string buffer", 1), name.size() + 1);
+  }
+  EXPECT_EQ(allocations.load() - before, 0u);
+}
+
+TEST(LRUCacheAllocationTest, StaticCacheNeverAllocates) {
+  const auto before = allocations.load();
+  auto cache = lru::make_static_cache<16, square>();
+  for (int round = 0; round < 16; ++round) {
+    for (int i = 0; i < 64; ++i) {
+      EXPECT_EQ(cache(i % (16 + round)), square(i % (16 + round)));
+    }
+  }
+  EXPECT_EQ(allocations.load() - before, 0u);
+}
@@ -0,0 +1,161 @@
+#include "lru/async.hpp"
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+std::atomic<unsigned> calls{0};
+
+// Runs every task on the calling thread
+void run_inline(std::function<void()> task) { task(); }
+
+// Holds tasks until the test runs them
+struct ManualExecutor {
+  std::vector<std::function<void()>> *tasks;
+  void operator()(std::function<void()> task) const { tasks->push_back(std::move(task)); }
+};
+} // namespace
+
+long square(const int x) {
+  calls++;
+  return static_cast<long>(x) * x;
+}
+
+TEST(AsyncCacheTest, BasicFunctionality) {
+  calls = 0;
+  lru::thread_pool pool{4};
+  auto cache = lru::make_async_cache(square, pool, 100);
+
+  std::vector<std::shared_future<long>> results;
+  for (int round = 0; round < 3; ++round) {
+    for (int i = 0; i < 50; ++i) {
+      results.push_back(cache(i));
+    }
+  }
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    const long x = static_cast<long>(i % 50);
+    EXPECT_EQ(results[i].get(), x * x);
+  }
+  EXPECT_EQ(calls, 50u);
+}
+
+TEST(AsyncCacheTest, CallersShareTheInFlightFuture) {
+  std::vector<std::function<void()>> tasks;
+  std::atomic<unsigned> runs{0};
+  auto cache = lru::make_async_cache(
+      [&runs](const std::string &s) {
+        runs++;
+        return s.size();
+      },
+      ManualExecutor{&tasks}, 10);
+
+  const auto first = cache("pending");
+  const auto second = cache("pending");
+  ASSERT_EQ(tasks.size(), 1u);
+  EXPECT_EQ(first.wait_for(std::chrono::seconds{0}), std::future_status::timeout);
+
+  tasks.front()();
+  EXPECT_EQ(first.get(), 7u);
+  EXPECT_EQ(second.get(), 7u);
+  EXPECT_EQ(cache("pending").get(), 7u);
+  EXPECT_EQ(runs, 1u);
+}
+
+TEST(AsyncCacheTest, FailedFuturesAreNotCached) {
+  int attempts = 0;
+  auto cache = lru::make_async_cache(
+      [&attempts](const int x) {
+        if (++attempts == 1) {
+          throw std::runtime_error("transient");
+        }
+        return x + 1;
+      },
+      run_inline, 10);
+
+  const auto failed = cache(1);
+  EXPECT_THROW(failed.get(), std::runtime_error);
+  EXPECT_EQ(cache(1).get(), 2);
+  EXPECT_EQ(cache(1).get(), 2);
+  EXPECT_EQ(attempts, 2);
+}
+
+TEST(AsyncCacheTest, FailedExecutorFailsTheMiss) {
+  auto cache = lru::make_async_cache([](const int x) { return x; },
+                                     [](std::function<void()>) { throw std::runtime_error("rejected"); }, 10);
+  EXPECT_THROW(cache(1), std::runtime_error);
+  EXPECT_THROW(cache(1), std::runtime_error);
+}
+
+TEST(AsyncCacheTest, DestructorWaitsForRunningMisses) {
+  std::atomic<bool> finished{false};
+  {
+    lru::thread_pool pool{2};
+    lru::AsyncCache<int, int> cache(
+        [&finished](const int x) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(20));
+          finished = true;
+          return x;
+        },
+        pool, 10);
+    cache(1);
+  }
+  EXPECT_TRUE(finished);
+}
+
+TEST(AsyncCacheTest, ConcurrentCallers) {
+  calls = 0;
+  lru::thread_pool pool{2};
+  auto cache = lru::make_async_cache(square, pool, 1000);
+
+  std::vector<std::thread> callers;
+  for (int t = 0; t < 4; ++t) {
+    callers.emplace_back([&cache] {
+      for (int i = 0; i < 2000; ++i) {
+        const int x = i % 500;
+        EXPECT_EQ(cache(x).get(), static_cast<long>(x) * x);
+      }
+    });
+  }
+  for (auto &caller : callers) {
+    caller.join();
+  }
+  EXPECT_EQ(calls, 500u);
+}
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+namespace {
+// A coroutine that starts at once and never suspends at its ends
+struct Detached {
+  struct promise_type {
+    Detached get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+template <typename Cache> Detached sum(Cache &cache, const int n, std::promise<long> &out) {
+  long total = 0;
+  for (int i = 0; i < n; ++i) {
+    total += co_await cache.async(i % 4);
+  }
+  out.set_value(total);
+}
+} // namespace
+
+TEST(AsyncCacheTest, CoroutinesAwaitResults) {
+  calls = 0;
+  lru::thread_pool pool{1};
+  auto cache = lru::make_async_cache(square, pool, 10);
+  std::promise<long> total;
+  sum(cache, 8, total);
+  EXPECT_EQ(total.get_future().get(), 2 * (0 + 1 + 4 + 9));
+  EXPECT_EQ(calls, 4u);
+}
+#endif
@@ -0,0 +1,306 @@
+#include "lru/concurrent.hpp"
+#include <atomic>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+std::atomic<unsigned> calls{0};
+}
+
+long cube(const int x) {
+  calls++;
+  return static_cast<long>(x) * x * x;
+}
+
+TEST(ConcurrentCacheTest, BasicFunctionality) {
+  calls = 0;
+  auto cache = lru::make_concurrent_cache(cube, 64, 4);
+  EXPECT_EQ(cache.shards(), 4u);
+
+  EXPECT_EQ(cache(3), 27);
+  EXPECT_EQ(cache(3), 27); // Should hit the cache
+  EXPECT_EQ(calls, 1u);
+
+  // Wider than any shard: early keys are evicted again
+  for (int i = 0; i < 1024; ++i) {
+    EXPECT_EQ(cache(i), cube(i));
+  }
+  calls = 0;
+  cache(3);
+  EXPECT_EQ(calls, 1u);
+}
+
+TEST(ConcurrentCacheTest, EraseDropsOneEntry) {
+  calls = 0;
+  auto cache = lru::make_concurrent_cache(cube, 64, 4);
+  cache(2);
+  cache(3);
+  EXPECT_TRUE(cache.erase(2));
+  EXPECT_FALSE(cache.erase(2));
+  cache(2);
+  cache(3);
+  EXPECT_EQ(calls, 3u);
+}
+
+TEST(ConcurrentCacheTest, ParallelCallersSeeCorrectResults) {
+  calls = 0;
+  auto cache = lru::make_concurrent_cache(cube, 256);
+  constexpr int threads = 8;
+  constexpr int keys = 128; // Fits: every key is computed a bounded number of times
+
+  std::vector<std::thread> pool;
+  std::atomic<bool> mismatch{false};
+  for (int t = 0; t < threads; ++t) {
+    pool.emplace_back([&, t] {
+      for (int round = 0; round < 200; ++round) {
+        for (int i = 0; i < keys; ++i) {
+          const int key = (i * 7 + t) % keys;
+          if (cache(key) != static_cast<long>(key) * key * key) {
+            mismatch = true;
+          }
+        }
+      }
+    });
+  }
+  for (auto &thread : pool) {
+    thread.join();
+  }
+  EXPECT_FALSE(mismatch);
+  // Racing misses may each compute, but never more than once per thread
+  EXPECT_LE(calls, unsigned(threads * keys));
+}
+
+TEST(ConcurrentCacheTest, StringArguments) {
+  auto cache = lru::make_concurrent_cache([](const std::string &s) { return s.size(); }, 16, 2);
+  EXPECT_EQ(cache("hello"), 5u);
+  EXPECT_EQ(cache(std::string(100, 'x')), 100u);
+}
+
+TEST(ConcurrentCacheTest, FingerprintedKeys) {
+  std::atomic<int> calls{0};
+  auto cache = lru::make_concurrent_cache<lru::single_flight, lru::fingerprinted>(
+      [&calls](const std::string &s) {
+        ++calls;
+        return s.size();
+      },
+      16, 2);
+  const std::string text(1000, 'x');
+  EXPECT_EQ(cache(text), 1000u);
+  EXPECT_EQ(cache(text), 1000u);
+  EXPECT_EQ(calls, 1);
+  EXPECT_TRUE(cache.erase(text));
+  EXPECT_EQ(cache(text), 1000u);
+  EXPECT_EQ(calls, 2);
+}
+
+TEST(ConcurrentCacheTest, ClockHitsUnderSharedLock) {
+  calls = 0;
+  auto cache = lru::make_concurrent_cache<lru::policy::clock>(cube, 64, 2);
+  std::vector<std::thread> pool;
+  std::atomic<bool> mismatch{false};
+  for (int t = 0; t < 8; ++t) {
+    pool.emplace_back([&] {
+      for (int i = 0; i < 20000; ++i) {
+        const int key = i % 96; // Wider than the cache: hits, misses and sweeps
+        if (cache(key) != static_cast<long>(key) * key * key) {
+          mismatch = true;
+        }
+      }
+    });
+  }
+  for (auto &thread : pool) {
+    thread.join();
+  }
+  EXPECT_FALSE(mismatch);
+}
+
+namespace {
+std::atomic<unsigned> slow_calls{0};
+}
+
+int slow_square(const int x) {
+  slow_calls++;
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  if (x < 0) {
+    throw std::invalid_argument("negative");
+  }
+  return x * x;
+}
+
+TEST(ConcurrentCacheTest, WeightedShardsStayWithinBudget) {
+  const auto bytes = [](std::tuple<int> const &, std::string const &s) { return s.size(); };
+  auto cache = lru::make_concurrent_cache([](const int n) { return std::string(n % 100, 'x'); }, 1024, bytes, 4000, 4);
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_EQ(cache(i).size(), std::size_t(i % 100));
+    EXPECT_LE(cache.weight(), 4000u);
+  }
+  EXPECT_GT(cache.weight(), 0u);
+}
+
+TEST(ConcurrentCacheTest, WeightedShardsAdmitEntriesOfABudgetSmallerThanTheShards) {
+  // 64 shards asked for: an even split would give each 40 / 64 = 0
+  int calls = 0;
+  const auto bytes = [](std::tuple<int> const &, std::string const &s) { return s.size(); };
+  auto cache = lru::make_concurrent_cache(
+      [&calls](const int n) {
+        ++calls;
+        return std::string(4, char('a' + n));
+      },
+      1024, bytes, 40, 64);
+  for (int round = 0; round < 3; ++round) {
+    for (int i = 0; i < 4; ++i) {
+      EXPECT_EQ(cache(i), std::string(4, char('a' + i)));
+    }
+  }
+  EXPECT_EQ(calls, 4);
+  EXPECT_EQ(cache.weight(), 16u);
+
+  // The reported case: 20-byte results in a 1000-byte budget
+  auto large = lru::make_concurrent_cache([](const int n) { return std::string(20, char('a' + n)); }, 1024, bytes,
+                                          1000, 64);
+  for (int i = 0; i < 12; ++i) {
+    large(i % 4);
+  }
+  EXPECT_EQ(large.weight(), 80u);
+}
+
+TEST(ConcurrentCacheTest, ExpiryAppliesToEveryShard) {
+  using namespace std::chrono_literals;
+  calls = 0;
+  auto cache = lru::make_concurrent_cache<lru::expiring<>>(cube, 64, 4);
+  cache.expire_after(1h);
+  for (int i = 0; i < 32; ++i) {
+    cache(i);
+    cache(i);
+  }
+  EXPECT_EQ(calls, 32u);
+
+  // Expired as soon as cached
+  cache.expire_after(0s);
+  for (int i = 32; i < 64; ++i) {
+    cache(i);
+    cache(i);
+  }
+  EXPECT_EQ(calls, 96u);
+  cache.evict_expired();
+}
+
+TEST(ConcurrentCacheTest, SingleFlightCoalescesMisses) {
+  slow_calls = 0;
+  auto cache = lru::make_concurrent_cache<lru::single_flight>(slow_square, 16);
+  std::vector<std::thread> pool;
+  std::atomic<int> correct{0};
+  for (int t = 0; t < 8; ++t) {
+    pool.emplace_back([&] { correct += cache(7) == 49; });
+  }
+  for (auto &thread : pool) {
+    thread.join();
+  }
+  EXPECT_EQ(correct, 8);
+  EXPECT_EQ(slow_calls, 1u);
+}
+
+TEST(ConcurrentCacheTest, SingleFlightSurvivesAThrowingWeigher) {
+  std::atomic<int> empty_calls{0};
+  const auto weigher = [](std::tuple<std::string> const &key, std::size_t const &) -> std::size_t {
+    if (std::get<0>(key) == "boom") {
+      throw std::runtime_error("boom");
+    }
+    return 1;
+  };
+  auto cache = lru::make_concurrent_cache<lru::single_flight>(
+      [&empty_calls](std::string const &s) {
+        if (s.empty()) {
+          ++empty_calls;
+          std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        }
+        return s.size();
+      },
+      16, weigher, 100, 1);
+  // A leader computes "" while the insert of "boom" throws in the same shard
+  std::thread leader([&] { EXPECT_EQ(cache(""), 0u); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_THROW(cache("boom"), std::runtime_error);
+  // ""'s marker is still there: this call waits for the leader
+  std::thread waiter([&] { EXPECT_EQ(cache(""), 0u); });
+  leader.join();
+  waiter.join();
+  EXPECT_EQ(empty_calls, 1);
+}
+
+TEST(ConcurrentCacheTest, SingleFlightSharesExceptionsWithoutCaching) {
+  slow_calls = 0;
+  auto cache = lru::make_concurrent_cache<lru::single_flight>(slow_square, 16);
+  std::vector<std::thread> pool;
+  std::atomic<int> thrown{0};
+  for (int t = 0; t < 8; ++t) {
+    pool.emplace_back([&] {
+      try {
+        cache(-1);
+      } catch (const std::invalid_argument &) {
+        thrown++;
+      }
+    });
+  }
+  for (auto &thread : pool) {
+    thread.join();
+  }
+  EXPECT_EQ(thrown, 8);
+  EXPECT_EQ(slow_calls, 1u);
+
+  // The failure was not cached
+  EXPECT_THROW(cache(-1), std::invalid_argument);
+  EXPECT_EQ(slow_calls, 2u);
+}
+
+TEST(ConcurrentCacheTest, StatsAddUpOverShards) {
+  auto cache = lru::make_concurrent_cache<lru::policy::clock, lru::instrumented<>>(cube, 1024, 8);
+  std::vector<std::thread> pool;
+  for (int t = 0; t < 4; ++t) {
+    pool.emplace_back([&] {
+      for (int i = 0; i < 1000; ++i) {
+        cache(i % 100);
+      }
+    });
+  }
+  for (auto &thread : pool) {
+    thread.join();
+  }
+  const auto stats = cache.stats();
+  EXPECT_EQ(stats.hits + stats.misses, 4000u);
+  // Racing misses on a key compute it more than once, but store it once
+  EXPECT_GE(stats.misses, 100u);
+  EXPECT_EQ(stats.miss_latency.count(), stats.misses);
+  EXPECT_EQ(stats.size, 100u);
+  EXPECT_EQ(stats.inserts, 100u);
+  EXPECT_EQ(stats.capacity, 1024u);
+}
+
+TEST(ConcurrentCacheTest, ResizeAndClearWhileServing) {
+  auto cache = lru::make_concurrent_cache(cube, 1024, 8);
+  std::atomic<bool> done{false};
+  std::vector<std::thread> pool;
+  for (int t = 0; t < 3; ++t) {
+    pool.emplace_back([&] {
+      for (int i = 0; !done; ++i) {
+        const int x = i % 2000;
+        ASSERT_EQ(cache(x), static_cast<long>(x) * x * x);
+      }
+    });
+  }
+  for (std::size_t capacity : {64u, 4096u, 512u}) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    cache.resize(capacity);
+    EXPECT_EQ(cache.capacity(), capacity);
+    cache.clear();
+  }
+  done = true;
+  for (auto &thread : pool) {
+    thread.join();
+  }
+  EXPECT_LE(cache.weight(), 512u);
+}
@@ -1,5 +1,15 @@
 #include "lru/lru.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <gtest/gtest.h>
+#include <limits>
+#include <list>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
 
 auto call_count = 0u;
 
@@ -14,37 +24,1056 @@ TEST(LRUCacheTest, BasicFunctionality) {
   auto cache= lru::make_cache(test_function);
   EXPECT_EQ(call_count, 0);
   // Test insertion and retrieval
-  EXPECT_EQ(cache(cache.capacity + 2), mul(cache.capacity + 2));
-  EXPECT_EQ(cache(cache.capacity + 3), mul(cache.capacity + 3));
+  EXPECT_EQ(cache(cache.capacity() + 2), mul(cache.capacity() + 2));
+  EXPECT_EQ(cache(cache.capacity() + 3), mul(cache.capacity() + 3));
 
   EXPECT_EQ(call_count, 2);
 
-  EXPECT_EQ(cache(cache.capacity + 2),
-            mul(cache.capacity + 2)); // Should hit the cache
+  EXPECT_EQ(cache(cache.capacity() + 2),
+            mul(cache.capacity() + 2)); // Should hit the cache
 
   EXPECT_EQ(call_count, 2);
 
   call_count = 0;
 
-  for (auto i = 0; i < cache.capacity; ++i) {
+  for (auto i = 0; i < cache.capacity(); ++i) {
     cache(i);
   }
 
-  EXPECT_EQ(call_count, cache.capacity);
+  EXPECT_EQ(call_count, cache.capacity());
 
-  for (int i = 0; i < cache.capacity; ++i) {
+  for (int i = 0; i < cache.capacity(); ++i) {
     cache(i);
   }
 
-  EXPECT_EQ(call_count, cache.capacity);
+  EXPECT_EQ(call_count, cache.capacity());
 
-  EXPECT_EQ(cache(cache.capacity + 2),
-            mul(cache.capacity + 2)); // Should be evicted and recomputed
-  EXPECT_EQ(call_count, cache.capacity + 1);
+  EXPECT_EQ(cache(cache.capacity() + 2),
+            mul(cache.capacity() + 2)); // Should be evicted and recomputed
+  EXPECT_EQ(call_count, cache.capacity() + 1);
 
   EXPECT_EQ(cache(0), 0);
 
-  EXPECT_EQ(call_count, cache.capacity + 2);
+  EXPECT_EQ(call_count, cache.capacity() + 2);
+}
+
+auto label_calls = 0u;
+
+std::string label(const int id, const std::string &name) {
+  label_calls++;
+  return name + "#" + std::to_string(id);
+}
+
+TEST(LRUCacheTest, MatchesReferenceModel) {
+  // Replays a pseudo-random access stream against a naive LRU model
+  constexpr std::size_t capacity = 37;
+  auto cache = lru::make_cache(label, capacity);
+  std::list<std::pair<int, std::string>> model;
+
+  std::uint32_t state = 12345;
+  for (int step = 0; step < 20000; ++step) {
+    state = state * 1664525u + 1013904223u;
+    const int id = static_cast<int>(state >> 24) % 64;
+    const std::string name = (id % 3 == 0) ? "a long name that does not fit in the SSO buffer" : "short";
+
+    const auto it = std::find(model.begin(), model.end(), std::make_pair(id, name));
+    if (it != model.end()) {
+      model.splice(model.begin(), model, it);
+    } else {
+      if (model.size() == capacity) {
+        model.pop_back();
+      }
+      model.emplace_front(id, name);
+    }
+    ASSERT_EQ(cache(id, name), label(id, name));
+  }
+  // Every key still in the model must be a hit
+  label_calls = 0;
+  for (const auto &[id, name] : model) {
+    cache(id, name);
+  }
+  EXPECT_EQ(label_calls, 0u);
+}
+
+// Keys whose hashes all collide: they share a home group and a tag
+struct Clash {
+  std::string name;
+  bool operator==(Clash const &other) const { return name == other.name; }
+};
+
+template <> struct std::hash<Clash> {
+  std::size_t operator()(Clash const &) const noexcept { return 42; }
+};
+
+auto clash_calls = 0u;
+
+std::size_t clash_length(const Clash &key) {
+  clash_calls++;
+  return key.name.size();
+}
+
+TEST(LRUCacheTest, CollidingHashesSpillIntoNextGroups) {
+  // Several index groups' worth of entries probed from one home group,
+  // evicted and reinserted in pseudo-random order
+  constexpr std::size_t capacity = 50;
+  auto cache = lru::make_cache(clash_length, capacity);
+  std::list<int> model;
+
+  std::uint32_t state = 777;
+  for (int step = 0; step < 5000; ++step) {
+    state = state * 1664525u + 1013904223u;
+    const int id = static_cast<int>(state >> 24) % 80;
+    const auto it = std::find(model.begin(), model.end(), id);
+    if (it != model.end()) {
+      model.splice(model.begin(), model, it);
+    } else {
+      if (model.size() == capacity) {
+        model.pop_back();
+      }
+      model.push_front(id);
+    }
+    const Clash key{std::string(static_cast<std::size_t>(id), 'x')};
+    ASSERT_EQ(cache(key), key.name.size());
+  }
+  // Every key still in the model must be a hit
+  clash_calls = 0;
+  for (const int id : model) {
+    cache(Clash{std::string(static_cast<std::size_t>(id), 'x')});
+  }
+  EXPECT_EQ(clash_calls, 0u);
+}
+
+TEST(LRUCacheTest, ClockGivesReferencedEntriesASecondChance) {
+  call_count = 0;
+  auto cache = lru::make_cache<lru::policy::clock>(test_function, 3);
+  cache(1);
+  cache(2);
+  cache(3);
+  EXPECT_EQ(call_count, 3);
+
+  // Reference 1: the sweep clears its bit and evicts 2 instead
+  cache(1);
+  cache(4);
+  EXPECT_EQ(call_count, 4);
+  EXPECT_EQ(cache(1), mul(1));
+  EXPECT_EQ(call_count, 4);
+  EXPECT_EQ(cache(2), mul(2));
+  EXPECT_EQ(call_count, 5);
+
+  // Results stay correct under churn
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_EQ(cache(i % 7), mul(i % 7));
+  }
+}
+
+std::string repeat(const std::size_t n) { return std::string(n, 'x'); }
+
+TEST(LRUCacheTest, WeigherKeepsTotalWithinBudget) {
+  const auto size_of = [](std::tuple<std::size_t> const &, std::string const &s) { return s.size(); };
+  auto cache = lru::make_cache(repeat, 100, size_of, 1000);
+  EXPECT_EQ(cache.weight(), 0u);
+
+  cache(400);
+  cache(300);
+  EXPECT_EQ(cache.weight(), 700u);
+
+  // 400 is least recently used, and has to go for 500 to fit
+  cache(500);
+  EXPECT_EQ(cache.weight(), 800u);
+  cache(10);
+  EXPECT_EQ(cache.weight(), 810u);
+
+  // Heavier than the whole budget: returned, but not cached and nothing evicted
+  EXPECT_EQ(cache(5000).size(), 5000u);
+  EXPECT_EQ(cache.weight(), 810u);
+
+  for (std::size_t i = 1; i < 100; ++i) {
+    cache(i);
+    EXPECT_LE(cache.weight(), 1000u);
+  }
+}
+
+TEST(LRUCacheTest, UnweightedCacheWeighsEntriesByCount) {
+  auto cache = lru::make_cache(mul, 10);
+  for (int i = 0; i < 25; ++i) {
+    cache(i);
+    EXPECT_EQ(cache.weight(), std::min(i + 1, 10));
+  }
+}
+
+// Time only moves when a test advances it
+struct ManualClock {
+  using duration = std::chrono::nanoseconds;
+  using rep = duration::rep;
+  using period = duration::period;
+  using time_point = std::chrono::time_point<ManualClock>;
+  static constexpr bool is_steady = true;
+
+  static time_point now() noexcept { return time_point{elapsed}; }
+  static inline duration elapsed{};
+};
+
+// Tags each result with the time it was computed at
+std::pair<int, ManualClock::duration> stamped(const int x) {
+  call_count++;
+  return {x * x, ManualClock::elapsed};
+}
+
+using namespace std::chrono_literals;
+
+TEST(LRUCacheTest, ExpiredEntriesAreRecomputed) {
+  call_count = 0;
+  auto cache = lru::make_cache<lru::expiring<ManualClock>>(stamped, 10);
+  cache.expire_after(10s);
+
+  const auto first = cache(3);
+  ManualClock::elapsed += 9s;
+  EXPECT_EQ(cache(3), first);
+  EXPECT_EQ(call_count, 1u);
+
+  ManualClock::elapsed += 1s;
+  EXPECT_EQ(cache(3).second, ManualClock::elapsed);
+  EXPECT_EQ(call_count, 2u);
+  EXPECT_EQ(cache.weight(), 1u);
+}
+
+TEST(LRUCacheTest, TimeToLivePerEntry) {
+  call_count = 0;
+  auto cache = lru::make_cache<lru::expiring<ManualClock>>(stamped, 10);
+  // Odd keys live for a minute, even keys forever
+  cache.expire_after([](std::tuple<int> const &key, auto const &) {
+    return std::get<0>(key) % 2 ? ManualClock::duration{1min} : ManualClock::duration::max();
+  });
+  cache(1);
+  cache(2);
+  ManualClock::elapsed += 24h;
+  cache(1);
+  cache(2);
+  EXPECT_EQ(call_count, 3u);
+}
+
+TEST(LRUCacheTest, TimerWheelReclaimsExpiredEntries) {
+  // From a millisecond to weeks, across every level of the wheel
+  const auto ttl = [](const int key) { return ManualClock::duration{1ms} * (std::int64_t{1} << (key % 30)); };
+  auto cache = lru::make_cache<lru::expiring<ManualClock>>(stamped, 1000);
+  cache.expire_after([&](std::tuple<int> const &key, auto const &) { return ttl(std::get<0>(key)); });
+  const auto start = ManualClock::elapsed;
+  for (int i = 0; i < 1000; ++i) {
+    cache(i);
+  }
+  EXPECT_EQ(cache.weight(), 1000u);
+
+  for (int bit = 0; bit < 30; ++bit) {
+    ManualClock::elapsed += ManualClock::duration{1ms} * (std::int64_t{1} << bit);
+    cache.evict_expired();
+    std::size_t live = 0;
+    for (int i = 0; i < 1000; ++i) {
+      live += ttl(i) > ManualClock::elapsed - start;
+    }
+    // Reclaimed up to a millisecond late, never early
+    if (bit < 2) {
+      EXPECT_GE(cache.weight(), live);
+    } else {
+      EXPECT_EQ(cache.weight(), live);
+    }
+  }
+  ManualClock::elapsed += 1ms;
+  cache.evict_expired();
+  EXPECT_EQ(cache.weight(), 0u);
+}
+
+TEST(LRUCacheTest, TimerWheelExpiresPastDeadlinesOnTheNextAdvance) {
+  constexpr std::int64_t tick = std::int64_t{1} << 20;
+  lru::detail::timer_wheel wheel{2, 10 * tick};
+  std::vector<std::uint32_t> expired;
+  const auto expire = [&](const std::uint32_t slot) {
+    wheel.cancel(slot);
+    expired.push_back(slot);
+  };
+  // Due before the wheel's time, in a bucket the ring has passed
+  wheel.schedule(0, 5 * tick);
+  wheel.schedule(1, 10 * tick + 1);
+  wheel.advance(11 * tick, expire);
+  std::sort(expired.begin(), expired.end());
+  EXPECT_EQ(expired, (std::vector<std::uint32_t>{0, 1}));
+}
+
+TEST(LRUCacheTest, NeverReturnsExpiredResults) {
+  auto cache = lru::make_cache<lru::expiring<ManualClock>>(stamped, 64);
+  cache.expire_after([](std::tuple<int> const &key, auto const &) {
+    return ManualClock::duration{1ms} * (1 + std::get<0>(key) * 37 % 5000);
+  });
+  std::uint32_t state = 7;
+  for (int step = 0; step < 100000; ++step) {
+    state = state * 1664525u + 1013904223u;
+    const int key = static_cast<int>(state >> 20) % 128;
+    ManualClock::elapsed += ManualClock::duration{(state >> 8) % 200} * 1000;
+    const auto [value, computed] = cache(key);
+    ASSERT_EQ(value, key * key);
+    ASSERT_LT(ManualClock::elapsed - computed, ManualClock::duration{1ms} * (1 + key * 37 % 5000));
+  }
+}
+
+std::string greet(std::string name, const std::string &greeting) {
+  call_count++;
+  return greeting + ", " + name;
+}
+
+TEST(LRUCacheTest, StringViewsFindStringKeys) {
+  call_count = 0;
+  auto cache = lru::make_cache(greet);
+  const std::string world = "a world with a name longer than the small string buffer";
+  EXPECT_EQ(cache(world, "hello"), "hello, " + world);
+  EXPECT_EQ(cache(std::string_view{world}, std::string_view{"hello"}), "hello, " + world);
+  EXPECT_EQ(cache(world.c_str(), std::string{"hello"}), "hello, " + world);
+  EXPECT_EQ(call_count, 1u);
+
+  // A miss through views caches the copied strings
+  EXPECT_EQ(cache(std::string_view{world}.substr(2), "bye"), "bye, " + world.substr(2));
+  EXPECT_EQ(cache(world.substr(2), "bye"), "bye, " + world.substr(2));
+  EXPECT_EQ(call_count, 2u);
+}
+
+TEST(LRUCacheTest, ArgumentHashingMixesEveryArgument) {
+  // Keys differing only in their first argument must not share a hash
+  using Hash = lru::Cache<int, int, int>::MapHash;
+  EXPECT_NE(Hash{}(std::make_tuple(1, 7)), Hash{}(std::make_tuple(2, 7)));
+
+  // Packed keys: every byte of every element counts, wherever it lands in
+  // the 16-byte blocks
+  using Packed = std::tuple<char, double, short, long, bool, float, unsigned char, std::int64_t>;
+  using PackedHash = lru::detail::tuple_hash<Packed>;
+  const Packed base{'a', 1.5, 2, 3, true, 4.5f, 5, 6};
+  const auto hash = PackedHash{}(base);
+  EXPECT_NE(PackedHash{}(Packed{'b', 1.5, 2, 3, true, 4.5f, 5, 6}), hash);
+  EXPECT_NE(PackedHash{}(Packed{'a', 1.5, 2, 3, true, 4.5f, 5, 7}), hash);
+  EXPECT_NE(PackedHash{}(Packed{'a', 1.5, 2, 3, false, 4.5f, 5, 6}), hash);
+  EXPECT_NE(PackedHash{}(Packed{'a', 1.5, 2, std::int64_t{1} << 62 | 3, true, 4.5f, 5, 6}), hash);
+  EXPECT_EQ(PackedHash{}(Packed{base}), hash);
+}
+
+double inverse(const double x, const char unit) {
+  call_count++;
+  return unit == 'k' ? 1000 / x : 1 / x;
+}
+
+TEST(LRUCacheTest, TriviallyCopyableKeysCompareAsBytes) {
+  call_count = 0;
+  auto cache = lru::make_cache(inverse);
+  EXPECT_EQ(cache(0.0, 'u'), std::numeric_limits<double>::infinity());
+  EXPECT_EQ(cache(-0.0, 'u'), -std::numeric_limits<double>::infinity());
+  EXPECT_EQ(call_count, 2u);
+
+  // A NaN key is found again, where == would never match it
+  const auto nan = std::numeric_limits<double>::quiet_NaN();
+  cache(nan, 'k');
+  cache(nan, 'k');
+  EXPECT_EQ(call_count, 3u);
+  EXPECT_EQ(cache(4.0, 'k'), 250.0);
+  EXPECT_EQ(cache(4.0, 'u'), 0.25);
+  EXPECT_EQ(cache(4.0, 'k'), 250.0);
+  EXPECT_EQ(call_count, 5u);
+}
+
+std::string scaled(const double x, std::string const &unit) {
+  call_count++;
+  return std::to_string(1 / x) + unit;
+}
+
+TEST(LRUCacheTest, FloatingPointKeysCompareBitsWhateverTheOtherArguments) {
+  // Not packed because of the string, but keyed like inverse's arguments
+  call_count = 0;
+  auto cache = lru::make_cache(scaled);
+  EXPECT_EQ(cache(0.0, "u"), "inf" + std::string{"u"});
+  EXPECT_EQ(cache(-0.0, "u"), "-inf" + std::string{"u"});
+  EXPECT_EQ(call_count, 2u);
+  const auto nan = std::numeric_limits<double>::quiet_NaN();
+  cache(nan, "k");
+  cache(nan, "k");
+  EXPECT_EQ(call_count, 3u);
+}
+
+long double halve(const long double x) {
+  call_count++;
+  return x / 2;
+}
+
+TEST(LRUCacheTest, LongDoubleKeysIgnorePadding) {
+  call_count = 0;
+  auto cache = lru::make_cache(halve);
+  // Built on the stack over different garbage, so any padding differs
+  volatile long double one = 1.0L;
+  EXPECT_EQ(cache(one), 0.5L);
+  {
+    volatile unsigned char noise[64];
+    std::memset(const_cast<unsigned char *>(noise), 0xA5, sizeof(noise));
+  }
+  volatile long double again = 1.0L;
+  EXPECT_EQ(cache(again), 0.5L);
+  EXPECT_EQ(call_count, 1u);
+  EXPECT_EQ(cache(-0.0L), -0.0L);
+  EXPECT_EQ(call_count, 2u);
+
+  // Whatever their padding, equal values hash alike, in the table and in a
+  // fingerprint
+  long double a, b;
+  std::memset(&a, 0x00, sizeof(a));
+  std::memset(&b, 0xFF, sizeof(b));
+  a = b = 3.25L;
+  using Hash = lru::detail::tuple_hash<std::tuple<long double>>;
+  EXPECT_EQ(Hash{}(std::make_tuple(a)), Hash{}(std::make_tuple(b)));
+  EXPECT_TRUE(lru::detail::tuple_equal<std::tuple<long double>>{}(std::make_tuple(a), std::make_tuple(b)));
+  using Fingerprint = lru::detail::tuple_fingerprint<std::tuple<long double, std::string>>;
+  EXPECT_EQ(Fingerprint{}(std::make_tuple(a, std::string{"x"})), Fingerprint{}(std::make_tuple(b, std::string{"x"})));
+}
+
+std::unique_ptr<int> boxed(const int x) { return std::make_unique<int>(x * x); }
+
+TEST(LRUCacheTest, MoveOnlyResults) {
+  auto cache = lru::make_cache(boxed, 4);
+  const auto &first = cache.get(3);
+  EXPECT_EQ(*first, 9);
+  // A hit returns the very same object
+  EXPECT_EQ(&cache.get(3), &first);
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(*cache.get(i), i * i);
+  }
+}
+
+// Counts the copies made of a result
+struct Tracked {
+  static inline unsigned copies = 0;
+
+  explicit Tracked(const int value) : value{value} {}
+  Tracked(const Tracked &other) : value{other.value} { ++copies; }
+  Tracked(Tracked &&) noexcept = default;
+  Tracked &operator=(const Tracked &) = delete;
+  Tracked &operator=(Tracked &&) = delete;
+
+  int value;
+};
+
+Tracked track(const int x) { return Tracked{x}; }
+
+TEST(LRUCacheTest, GetCopiesNothing) {
+  auto cache = lru::make_cache(track, 8);
+  Tracked::copies = 0;
+  for (int round = 0; round < 4; ++round) {
+    for (int i = 0; i < 16; ++i) {
+      EXPECT_EQ(cache.get(i).value, i);
+    }
+  }
+  EXPECT_EQ(Tracked::copies, 0u);
+
+  // operator() returns by value: one copy per call
+  EXPECT_EQ(cache(15).value, 15);
+  EXPECT_EQ(Tracked::copies, 1u);
+}
+
+TEST(LRUCacheTest, CompileTimeFunction) {
+  call_count = 0;
+  auto cache = lru::make_cache<&test_function>(16);
+  static_assert(std::is_empty_v<decltype(cache)::Function>);
+  EXPECT_EQ(cache(4), 16);
+  EXPECT_EQ(cache(4), 16);
+  EXPECT_EQ(call_count, 1u);
+
+  auto clock_cache = lru::make_cache<&test_function, lru::policy::clock>(16);
+  static_assert(std::is_same_v<decltype(clock_cache)::Policy, lru::policy::clock>);
+  EXPECT_EQ(clock_cache(5), 25);
+}
+
+TEST(LRUCacheTest, LambdasAreStoredByValue) {
+  int calls = 0;
+  auto cache = lru::make_cache([&calls](const int x) { return x + ++calls; }, 16);
+  static_assert(!std::is_same_v<decltype(cache)::Function, std::function<int(int)>>);
+  EXPECT_EQ(cache(10), 11);
+  EXPECT_EQ(cache(10), 11);
+  EXPECT_EQ(calls, 1);
+
+  // Stateful functors may change on each call
+  auto counting = lru::make_cache([n = 0](const int x) mutable { return x * 100 + ++n; }, 16);
+  EXPECT_EQ(counting(1), 101);
+  EXPECT_EQ(counting(2), 202);
+  EXPECT_EQ(counting(1), 101);
+}
+
+struct Scaler {
+  int factor;
+  unsigned calls = 0;
+
+  int scale(const int x) {
+    ++calls;
+    return x * factor;
+  }
+};
+
+TEST(LRUCacheTest, MemberFunctions) {
+  Scaler scaler{3};
+  auto cache = lru::make_cache<&Scaler::scale>(scaler, 16);
+  EXPECT_EQ(cache(7), 21);
+  EXPECT_EQ(cache(7), 21);
+  EXPECT_EQ(scaler.calls, 1u);
+}
+
+TEST(LRUCacheTest, RecursiveCallsGoThroughTheCache) {
+  // Context travels in the capture instead of through globals
+  const std::vector<std::string> words{"cat", "cats", "dog", "sand", "and"};
+  unsigned calls = 0;
+  auto splits = lru::make_recursive_cache(
+      [&](lru::recursive<long(const std::string &)> &self, const std::string &s) -> long {
+        ++calls;
+        if (s.empty()) {
+          return 1;
+        }
+        long total = 0;
+        for (const auto &word : words) {
+          if (s.compare(0, word.size(), word) == 0) {
+            total += self(s.substr(word.size()));
+          }
+        }
+        return total;
+      },
+      64);
+  EXPECT_EQ(splits("catsanddog"), 2);
+  EXPECT_EQ(splits("catsanddogcatsanddog"), 4);
+  const auto after_two = calls;
+  EXPECT_EQ(splits("catsanddog"), 2);
+  EXPECT_EQ(calls, after_two);
+}
+
+TEST(LRUCacheTest, RecursionSurvivesNestedEvictions) {
+  // Far fewer slots than frames on the stack: nested misses keep evicting
+  // entries the outer frames have already looked up
+  auto fib = lru::make_recursive_cache(
+      [](lru::recursive<std::uint64_t(int)> &self, const int n) -> std::uint64_t {
+        return n < 2 ? static_cast<std::uint64_t>(n) : self(n - 1) + self(n - 2);
+      },
+      2);
+  std::uint64_t a = 0, b = 1;
+  for (int n = 0; n <= 25; ++n) {
+    EXPECT_EQ(fib(n), a);
+    b = std::exchange(a, b) + b;
+  }
+  EXPECT_EQ(fib.get(30), 832040u);
+}
+
+TEST(LRUCacheTest, GetManyMatchesSingleCalls) {
+  call_count = 0;
+  auto cache = lru::make_cache(test_function, 64);
+  std::vector<int> keys;
+  for (int i = 0; i < 100; ++i) {
+    keys.push_back(i * 7 % 40);
+  }
+  std::vector<int> values(keys.size());
+  EXPECT_EQ(cache.get_many(keys.begin(), keys.end(), values.begin()), values.end());
+  for (std::size_t i = 0; i < keys.size(); ++i) {
+    EXPECT_EQ(values[i], mul(keys[i]));
+  }
+  // Duplicates that missed are computed once
+  EXPECT_EQ(call_count, 40u);
+  call_count = 0;
+  for (int i = 0; i < 40; ++i) {
+    cache(i);
+  }
+  EXPECT_EQ(call_count, 0u);
+
+  // All hits now
+  std::fill(values.begin(), values.end(), -1);
+  cache.get_many(keys.begin(), keys.end(), values.data());
+  for (std::size_t i = 0; i < keys.size(); ++i) {
+    EXPECT_EQ(values[i], mul(keys[i]));
+  }
+  EXPECT_EQ(call_count, 0u);
+}
+
+TEST(LRUCacheTest, GetManyComputesMissesInOneBatch) {
+  auto cache = lru::make_cache(label, 16);
+  using Key = decltype(cache)::Key;
+  cache(1, "cached");
+
+  unsigned batches = 0;
+  const auto batch = [&](std::vector<Key> const &missed) {
+    ++batches;
+    std::vector<std::string> values;
+    for (const auto &[id, name] : missed) {
+      values.push_back("batched " + label(id, name));
+    }
+    return values;
+  };
+  const std::vector<Key> keys = {{1, "cached"}, {2, "new"}, {3, "new"}, {1, "cached"}};
+  std::vector<std::string> values(keys.size());
+  cache.get_many(keys.begin(), keys.end(), values.begin(), batch);
+  EXPECT_EQ(batches, 1u);
+  EXPECT_EQ(values, (std::vector<std::string>{"cached#1", "batched new#2", "batched new#3", "cached#1"}));
+  EXPECT_EQ(cache(2, "new"), "batched new#2");
+
+  // Nothing to compute, no batch
+  cache.get_many(keys.begin(), keys.end(), values.begin(), batch);
+  EXPECT_EQ(batches, 1u);
+}
+
+TEST(LRUCacheTest, GetManyBatchesARepeatedMissOnce) {
+  auto cache = lru::make_cache(label, 16);
+  using Key = decltype(cache)::Key;
+  std::vector<Key> batched;
+  const auto batch = [&](std::vector<Key> const &missed) {
+    batched.insert(batched.end(), missed.begin(), missed.end());
+    std::vector<std::string> values;
+    for (const auto &[id, name] : missed) {
+      values.push_back("batched " + label(id, name));
+    }
+    return values;
+  };
+  const std::vector<Key> keys = {{2, "new"}, {3, "new"}, {2, "new"}, {4, "new"}, {2, "new"}, {3, "new"}};
+  std::vector<std::string> values(keys.size());
+  cache.get_many(keys.begin(), keys.end(), values.begin(), batch);
+  // In the order of their first position
+  EXPECT_EQ(batched, (std::vector<Key>{{2, "new"}, {3, "new"}, {4, "new"}}));
+  EXPECT_EQ(values, (std::vector<std::string>{"batched new#2", "batched new#3", "batched new#2", "batched new#4",
+                                              "batched new#2", "batched new#3"}));
+  EXPECT_EQ(cache(4, "new"), "batched new#4");
+}
+
+// Takes x microseconds of ManualClock time
+int slow_square(const int x) {
+  ManualClock::elapsed += std::chrono::microseconds{x};
+  return x * x;
+}
+
+TEST(LRUCacheTest, StatsCountLookupsAndEvictions) {
+  auto cache = lru::make_cache<lru::instrumented<ManualClock>>(slow_square, 3);
+  for (const int x : {1, 2, 3, 1, 4}) {
+    cache(x);
+  }
+  const auto stats = cache.stats();
+  EXPECT_EQ(stats.hits, 1u);
+  EXPECT_EQ(stats.misses, 4u);
+  EXPECT_EQ(stats.inserts, 4u);
+  EXPECT_EQ(stats.evictions, 1u);
+  EXPECT_EQ(stats.erases, 1u);
+  EXPECT_EQ(stats.expirations, 0u);
+  EXPECT_EQ(stats.size, 3u);
+  EXPECT_EQ(stats.capacity, 3u);
+  EXPECT_EQ(stats.weight, 3u);
+  EXPECT_DOUBLE_EQ(stats.hit_ratio(), 0.2);
+  EXPECT_GT(stats.memory_bytes, sizeof(cache));
+
+  // One sample per call of the function: 1, 2, 3 and 4us
+  EXPECT_EQ(stats.miss_latency.count(), 4u);
+  EXPECT_DOUBLE_EQ(stats.miss_latency.mean(), 2500.0);
+  EXPECT_EQ(stats.miss_latency.percentile(0.0), 1023u);
+  EXPECT_EQ(stats.miss_latency.percentile(1.0), 4095u);
+}
+
+TEST(LRUCacheTest, StatsCountExpirations) {
+  auto cache = lru::make_cache<lru::expiring<ManualClock>, lru::instrumented<ManualClock>>(stamped, 10);
+  cache.expire_after(10s);
+  cache(1);
+  cache(2);
+  ManualClock::elapsed += 10s;
+  // Found expired, then recomputed
+  cache(1);
+  cache.evict_expired();
+  const auto stats = cache.stats();
+  EXPECT_EQ(stats.misses, 3u);
+  EXPECT_EQ(stats.expirations, 2u);
+  EXPECT_EQ(stats.erases, 2u);
+  EXPECT_EQ(stats.evictions, 0u);
+  EXPECT_EQ(stats.size, 1u);
+}
+
+TEST(LRUCacheTest, LatencyHistogramBucketsAreTight) {
+  lru::latency_histogram histogram;
+  for (std::uint64_t nanos = 0; nanos < 4; ++nanos) {
+    histogram.record(nanos);
+  }
+  EXPECT_EQ(histogram.percentile(0.0), 0u);
+  EXPECT_EQ(histogram.percentile(1.0), 3u);
+
+  // Every duration lands in a bucket at most 25% wider than its lower bound
+  for (std::uint64_t nanos = 4; nanos < (std::uint64_t{1} << 40); nanos = nanos * 9 / 8 + 1) {
+    lru::latency_histogram single;
+    single.record(nanos);
+    const auto upper = single.percentile(0.5);
+    EXPECT_GE(upper, nanos);
+    EXPECT_LE(upper, nanos + nanos / 4);
+  }
+}
+
+TEST(LRUCacheTest, TraceRecordsEveryLookup) {
+  const auto path = testing::TempDir() + "lru_cache_test.trace";
+  auto cache = lru::make_cache<lru::traced>(mul, 4);
+  using Cache = decltype(cache);
+  const std::vector<int> keys = {1, 2, 1, 3, 5, 8, 1};
+  {
+    lru::trace_writer writer{path};
+    cache.record_to(&writer);
+    for (const int key : keys) {
+      cache(key);
+    }
+    cache.record_to(nullptr);
+    cache(13);
+    EXPECT_EQ(writer.size(), keys.size());
+  }
+
+  lru::trace_reader reader{path};
+  ASSERT_EQ(reader.size(), keys.size());
+  std::vector<std::uint64_t> hashes(keys.size() + 1);
+  ASSERT_EQ(reader.read(hashes.data(), hashes.size()), keys.size());
+  for (std::size_t i = 0; i < keys.size(); ++i) {
+    EXPECT_EQ(hashes[i], Cache::MapHash{}(Cache::Key{keys[i]}));
+  }
+  EXPECT_EQ(reader.read(hashes.data(), hashes.size()), 0u);
+}
+
+TEST(LRUCacheTest, SnapshotRestoresEntriesInRecencyOrder) {
+  const auto path = testing::TempDir() + "lru_cache_test.snapshot";
+  {
+    auto cache = lru::make_cache(test_function, 4);
+    for (const int x : {1, 2, 3, 4, 1}) {
+      cache(x);
+    }
+    cache.save(path);
+  }
+
+  call_count = 0;
+  auto cache = lru::make_cache(test_function, 4);
+  cache.load(path);
+  EXPECT_EQ(cache.weight(), 4u);
+  // Least recent first: 2 is evicted, then 3
+  cache(5);
+  cache(6);
+  for (const int x : {1, 4}) {
+    EXPECT_EQ(cache(x), x * x);
+  }
+  EXPECT_EQ(call_count, 2u);
+  cache(2);
+  EXPECT_EQ(call_count, 3u);
+
+  // A smaller cache keeps the most recent entries
+  auto small = lru::make_cache(test_function, 2);
+  small.load(path);
+  call_count = 0;
+  small(1);
+  small(4);
+  EXPECT_EQ(call_count, 0u);
+}
+
+TEST(LRUCacheTest, SnapshotThroughSerializer) {
+  const auto path = testing::TempDir() + "lru_cache_test.strings";
+  const auto write = [](std::ostream &out, auto const &key, std::string const &value) {
+    out << std::get<0>(key) << ' ' << std::get<1>(key).size() << ' ' << std::get<1>(key) << ' ' << value.size() << ' '
+        << value;
+  };
+  const auto read = [](std::istream &in) {
+    int id;
+    std::size_t size;
+    in >> id >> size;
+    std::string name(size, '\0');
+    in.get();
+    in.read(name.data(), static_cast<std::streamsize>(size));
+    in >> size;
+    std::string value(size, '\0');
+    in.get();
+    in.read(value.data(), static_cast<std::streamsize>(size));
+    return std::make_pair(std::make_tuple(id, std::move(name)), std::move(value));
+  };
+  {
+    auto cache = lru::make_cache(label, 8);
+    cache(1, "one");
+    cache(2, "a name with spaces");
+    cache.save(path, write);
+  }
+
+  auto cache = lru::make_cache(label, 8);
+  using Cache = decltype(cache);
+  cache.load(path, read);
+  EXPECT_EQ(cache.weight(), 2u);
+  const auto *hit = cache.find(Cache::Key{2, "a name with spaces"}, Cache::MapHash{}(Cache::Key{2, "a name with spaces"}));
+  ASSERT_NE(hit, nullptr);
+  EXPECT_EQ(*hit, label(2, "a name with spaces"));
+
+  // Flat snapshots of other types are refused
+  auto other = lru::make_cache([](const std::int64_t x) { return x; }, 8);
+  EXPECT_THROW(other.load(path), std::runtime_error);
+}
+
+TEST(LRUCacheTest, ResizeKeepsTheMostRecentEntries) {
+  auto cache = lru::make_cache<lru::instrumented<ManualClock>>(test_function, 8);
+  for (int i = 0; i < 8; ++i) {
+    cache(i);
+  }
+  cache(0);
+
+  // 0 and the three most recent before it stay
+  cache.resize(4);
+  EXPECT_EQ(cache.capacity(), 4u);
+  EXPECT_EQ(cache.weight(), 4u);
+  call_count = 0;
+  for (const int x : {5, 6, 7, 0}) {
+    EXPECT_EQ(cache(x), mul(x));
+  }
+  EXPECT_EQ(call_count, 0u);
+
+  // Growing keeps them all, in order, with room for more
+  cache.resize(10);
+  for (int i = 20; i < 26; ++i) {
+    cache(i);
+  }
+  EXPECT_EQ(call_count, 6u);
+  for (const int x : {5, 6, 7, 0}) {
+    cache(x);
+  }
+  EXPECT_EQ(call_count, 6u);
+  cache(26);
+  EXPECT_EQ(cache(20), mul(20));
+  EXPECT_EQ(call_count, 8u);
+
+  const auto stats = cache.stats();
+  EXPECT_EQ(stats.capacity, 10u);
+  EXPECT_EQ(stats.size, 10u);
+  EXPECT_EQ(stats.evictions, 6u);
+  EXPECT_THROW(cache.resize(0), std::length_error);
+}
+
+TEST(LRUCacheTest, ResizeKeepsWeightsAndDeadlines) {
+  call_count = 0;
+  auto cache = lru::make_cache<lru::expiring<ManualClock>>(stamped, 10);
+  cache.expire_after(10s);
+  cache(1);
+  ManualClock::elapsed += 5s;
+  cache(2);
+  cache.resize(20);
+  ManualClock::elapsed += 6s;
+  cache(1);
+  cache(2);
+  EXPECT_EQ(call_count, 3u);
+
+  const auto size_of = [](std::tuple<std::size_t> const &, std::string const &s) { return s.size(); };
+  auto weighted = lru::make_cache(repeat, 10, size_of, 100);
+  weighted(60);
+  weighted(30);
+  weighted.resize(1);
+  EXPECT_EQ(weighted.weight(), 30u);
+  weighted.resize(10);
+  weighted(60);
+  EXPECT_EQ(weighted.weight(), 90u);
+}
+
+TEST(LRUCacheTest, ClearMissesEveryEntryAndReclaimsThemFirst) {
+  auto cache = lru::make_cache<lru::instrumented<ManualClock>>(test_function, 4);
+  for (int i = 0; i < 4; ++i) {
+    cache(i);
+  }
+  cache.clear();
+  EXPECT_EQ(cache.weight(), 0u);
+  EXPECT_EQ(cache.stats().size, 0u);
+
+  // The first new entries take the slots of the old ones, evicting nothing
+  call_count = 0;
+  cache(0);
+  cache(10);
+  EXPECT_EQ(call_count, 2u);
+  EXPECT_EQ(cache.weight(), 2u);
+  EXPECT_EQ(cache.stats().evictions, 0u);
+  cache(11);
+  cache(12);
+  cache(10);
+  EXPECT_EQ(call_count, 4u);
+  EXPECT_EQ(cache.stats().evictions, 0u);
+  EXPECT_EQ(cache.stats().size, 4u);
+
+  // Clearing twice before anything is reclaimed
+  cache.clear();
+  cache(1);
+  cache.clear();
+  EXPECT_EQ(cache.weight(), 0u);
+  call_count = 0;
+  for (const int x : {1, 10, 11, 12, 0}) {
+    EXPECT_EQ(cache(x), mul(x));
+  }
+  EXPECT_EQ(call_count, 5u);
+  EXPECT_EQ(cache.weight(), 4u);
+}
+
+TEST(LRUCacheTest, ClearedEntriesAreNotSnapshotted) {
+  const auto path = testing::TempDir() + "lru_cache_test.cleared";
+  auto cache = lru::make_cache(mul, 8);
+  cache(1);
+  cache(2);
+  cache.clear();
+  cache(3);
+  cache.save(path);
+
+  auto restored = lru::make_cache(test_function, 8);
+  restored.load(path);
+  EXPECT_EQ(restored.weight(), 1u);
+}
+
+// Counts the bytes it hands out on top of the default resource
+class CountingResource : public std::pmr::memory_resource {
+public:
+  std::size_t in_use = 0;
+  std::size_t allocations = 0;
+
+private:
+  void *do_allocate(const std::size_t bytes, const std::size_t alignment) override {
+    in_use += bytes;
+    ++allocations;
+    return std::pmr::get_default_resource()->allocate(bytes, alignment);
+  }
+  void do_deallocate(void *p, const std::size_t bytes, const std::size_t alignment) override {
+    in_use -= bytes;
+    std::pmr::get_default_resource()->deallocate(p, bytes, alignment);
+  }
+  bool do_is_equal(std::pmr::memory_resource const &other) const noexcept override { return this == &other; }
+};
+
+TEST(LRUCacheTest, EntriesAreStoredInTheGivenResource) {
+  CountingResource resource;
+  {
+    auto cache = lru::make_cache<lru::expiring<ManualClock>>(label, 100, &resource);
+    const auto allocations = resource.allocations;
+    EXPECT_GE(allocations, 3u); // slots, index and timers
+    EXPECT_GE(resource.in_use, 100 * sizeof(std::pair<std::tuple<int, std::string>, std::string>));
+    for (int i = 0; i < 300; ++i) {
+      EXPECT_EQ(cache(i, "name"), label(i, "name"));
+    }
+    EXPECT_EQ(resource.allocations, allocations);
+
+    cache.resize(10);
+    EXPECT_GT(resource.allocations, allocations);
+    EXPECT_EQ(cache(299, "name"), label(299, "name"));
+  }
+  EXPECT_EQ(resource.in_use, 0u);
+}
+
+TEST(LRUCacheTest, HugePageResourceBacksLargeCaches) {
+  // Large enough for mappings of whole huge pages, bound to the last node
+  lru::huge_page_resource resource{static_cast<int>(lru::numa_nodes()) - 1};
+  auto cache = lru::make_cache([](const std::int64_t x) { return x * 3; }, 1 << 18, &resource);
+  for (std::int64_t i = 0; i < (1 << 19); ++i) {
+    ASSERT_EQ(cache(i), 3 * i);
+  }
+  for (std::int64_t i = (1 << 19) - 10; i < (1 << 19); ++i) {
+    EXPECT_EQ(cache.get(i), 3 * i);
+  }
+  cache.resize(1 << 19);
+  EXPECT_EQ(cache(std::int64_t{1} << 18), 3 << 18);
+}
+
+TEST(LRUCacheTest, FingerprintedKeysStoreNoArguments) {
+  int calls = 0;
+  auto cache = lru::make_cache<lru::fingerprinted>(
+      [&calls](std::string const &a, std::vector<int> const &b, const int c) {
+        ++calls;
+        return a.size() + b.size() + c;
+      },
+      16);
+  static_assert(std::is_same_v<decltype(cache)::Key, std::tuple<lru::fingerprint>>);
+  const std::string text(10000, 'x');
+  const std::vector<int> numbers(1000, 7);
+  EXPECT_EQ(cache(text, numbers, 1), 11001u);
+  EXPECT_EQ(cache(text, numbers, 1), 11001u);
+  // A view of the same string is the same key
+  EXPECT_EQ(cache(std::string_view{text}, numbers, 1), 11001u);
+  EXPECT_EQ(calls, 1);
+
+  // Lengths are hashed along with contents, so splits differ
+  EXPECT_EQ(cache("ab", {}, 0), 2u);
+  EXPECT_EQ(cache("a", {}, 1), 2u);
+  EXPECT_EQ(cache("", {'a'}, 1), 2u);
+  EXPECT_EQ(calls, 4);
+  EXPECT_EQ(cache(text, numbers, 2), 11002u);
+  EXPECT_EQ(calls, 5);
+
+  // Fingerprints are flat: snapshots store them as raw bytes
+  const std::string path = testing::TempDir() + "fingerprints.snapshot";
+  cache.save(path);
+  auto copy = lru::make_cache<lru::fingerprinted>([](std::string const &, std::vector<int> const &, int) {
+    ADD_FAILURE() << "a loaded fingerprint must hit";
+    return std::size_t{0};
+  });
+  copy.load(path);
+  EXPECT_EQ(copy(text, numbers, 1), 11001u);
+  EXPECT_EQ(copy("ab", {}, 0), 2u);
+}
+
+TEST(LRUCacheTest, FingerprintsDifferForCloseArguments) {
+  using Fingerprint = lru::detail::tuple_fingerprint<std::tuple<std::string, int>>;
+  std::vector<lru::fingerprint> seen;
+  for (int i = 0; i < 1000; ++i) {
+    seen.push_back(Fingerprint{}(std::make_tuple(std::string(static_cast<std::size_t>(i), 'a'), 0)));
+    seen.push_back(Fingerprint{}(std::make_tuple(std::string("key"), i)));
+  }
+  std::sort(seen.begin(), seen.end(), [](auto const &a, auto const &b) {
+    return std::tie(a.low, a.high) < std::tie(b.low, b.high);
+  });
+  EXPECT_EQ(std::adjacent_find(seen.begin(), seen.end()), seen.end());
+  // Both halves are hashes on their own
+  EXPECT_NE(seen[0].low, seen[0].high);
+}
+
+template <typename Policy> class PolicyTest : public testing::Test {};
+
+using Policies = testing::Types<lru::policy::lru, lru::policy::clock, lru::policy::slru, lru::policy::s3fifo,
+                                lru::policy::w_tinylfu>;
+TYPED_TEST_SUITE(PolicyTest, Policies);
+
+TYPED_TEST(PolicyTest, ResultsStayCorrectUnderChurn) {
+  auto cache = lru::make_cache<TypeParam>(label, 50);
+  std::uint32_t state = 99;
+  for (int step = 0; step < 50000; ++step) {
+    state = state * 1664525u + 1013904223u;
+    // Skewed towards small ids, with a long tail
+    const int id = static_cast<int>((state >> 16) % 256) % (1 + static_cast<int>((state >> 8) % 128));
+    const std::string name = (id % 2 == 0) ? "a long name that does not fit in the SSO buffer" : "short";
+    ASSERT_EQ(cache(id, name), label(id, name));
+  }
+}
+
+TYPED_TEST(PolicyTest, KeepsHotSetThroughScanUnlessRecencyOnly) {
+  auto cache = lru::make_cache<TypeParam>(test_function, 100);
+  // A hot set accessed repeatedly...
+  for (int round = 0; round < 10; ++round) {
+    for (int i = 0; i < 50; ++i) {
+      cache(i);
+    }
+  }
+  // ...then one pass over three times as many cold keys
+  for (int i = 1000; i < 1300; ++i) {
+    cache(i);
+  }
+  call_count = 0;
+  for (int i = 0; i < 50; ++i) {
+    EXPECT_EQ(cache(i), mul(i));
+  }
+  constexpr bool recency_only =
+      std::is_same_v<TypeParam, lru::policy::lru> || std::is_same_v<TypeParam, lru::policy::clock>;
+  if constexpr (recency_only) {
+    EXPECT_EQ(call_count, 50u);
+  } else {
+    EXPECT_EQ(call_count, 0u);
+  }
+}
+
+TYPED_TEST(PolicyTest, ResizeAndClearUnderChurn) {
+  auto cache = lru::make_cache<TypeParam>(label, 50);
+  std::uint32_t state = 7;
+  for (int step = 0; step < 20000; ++step) {
+    state = state * 1664525u + 1013904223u;
+    const int id = static_cast<int>((state >> 16) % 200);
+    const std::string name = (id % 2 == 0) ? "a long name that does not fit in the SSO buffer" : "short";
+    ASSERT_EQ(cache(id, name), label(id, name));
+    if (step % 1000 == 999) {
+      cache.resize(1 + (state >> 8) % 100);
+    } else if (step % 1000 == 499) {
+      cache.clear();
+      ASSERT_EQ(cache.weight(), 0u);
+    }
+    ASSERT_LE(cache.weight(), cache.capacity());
+  }
 }
 
 int main(int argc, char **argv) {
@@ -0,0 +1,182 @@
+#include "lru/static_cache.hpp"
+#include <gtest/gtest.h>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace {
+unsigned calls = 0;
+} // namespace
+
+long square(const int x) {
+  calls++;
+  return static_cast<long>(x) * x;
+}
+
+TEST(StaticCacheTest, BasicFunctionality) {
+  calls = 0;
+  auto cache = lru::make_static_cache<8, square>();
+  for (int round = 0; round < 3; ++round) {
+    for (int i = 0; i < 8; ++i) {
+      EXPECT_EQ(cache(i), static_cast<long>(i) * i);
+    }
+  }
+  EXPECT_EQ(calls, 8u);
+  EXPECT_EQ(cache.size(), 8u);
+  static_assert(decltype(cache)::capacity() == 8);
+}
+
+TEST(StaticCacheTest, EvictsTheLeastRecentlyUsed) {
+  calls = 0;
+  lru::StaticCache<3, long (*)(int)> cache{square};
+  cache(1);
+  cache(2);
+  cache(3);
+  cache(1); // 2 is now the oldest
+  cache(4);
+  EXPECT_TRUE(cache.contains(1));
+  EXPECT_FALSE(cache.contains(2));
+  EXPECT_TRUE(cache.contains(3));
+  EXPECT_TRUE(cache.contains(4));
+  EXPECT_EQ(calls, 4u);
+}
+
+TEST(StaticCacheTest, ScansPastOneBlockOfTags) {
+  // 100 entries span two 64-tag blocks, the second one partly empty
+  auto cache = lru::make_static_cache<100>([](const int x, const int y) { return x * 1000 + y; });
+  for (int i = 0; i < 100; ++i) {
+    cache(i, -i);
+  }
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_TRUE(cache.contains(i, -i));
+    EXPECT_EQ(cache.get(i, -i), i * 1000 - i);
+  }
+  EXPECT_FALSE(cache.contains(100, -100));
+  cache(100, -100);
+  EXPECT_FALSE(cache.contains(0, 0));
+  EXPECT_EQ(cache.size(), 100u);
+}
+
+TEST(StaticCacheTest, StringKeysAndViews) {
+  int runs = 0;
+  auto cache = lru::make_static_cache<4>([&runs](const std::string &s) {
+    runs++;
+    return s.size();
+  });
+  const std::string name = "a key that is too long for the small string buffer";
+  EXPECT_EQ(cache(name), name.size());
+  EXPECT_EQ(cache(std::string_view{name}), name.size());
+  EXPECT_EQ(cache("a key that is too long for the small string buffer"), name.size());
+  EXPECT_EQ(runs, 1);
+}
+
+TEST(StaticCacheTest, ThrowingFunctionCachesNothing) {
+  auto cache = lru::make_static_cache<2>([](const int x) {
+    if (x < 0) {
+      throw std::invalid_argument("negative");
+    }
+    return x;
+  });
+  cache(1);
+  cache(2);
+  EXPECT_THROW(cache(-1), std::invalid_argument);
+  EXPECT_EQ(cache.size(), 2u);
+  EXPECT_TRUE(cache.contains(1));
+  EXPECT_TRUE(cache.contains(2));
+}
+
+TEST(StaticCacheTest, CopiesAndMovesKeepEntries) {
+  auto cache = lru::make_static_cache<4>([](const int x) { return std::to_string(x); });
+  for (int i = 0; i < 6; ++i) {
+    cache(i);
+  }
+  auto copy = cache;
+  cache.clear();
+  EXPECT_EQ(cache.size(), 0u);
+  EXPECT_FALSE(cache.contains(5));
+
+  const auto moved = std::move(copy);
+  EXPECT_EQ(moved.size(), 4u);
+  for (int i = 2; i < 6; ++i) {
+    EXPECT_TRUE(moved.contains(i));
+  }
+  EXPECT_FALSE(moved.contains(1));
+}
+
+// Counts its live instances; copies and moves throw once `passes_left`
+// runs out (-1 for never)
+struct Fragile {
+  static inline int live = 0;
+  static inline int passes_left = -1;
+
+  explicit Fragile(const int value) : value{value} { ++live; }
+  Fragile(Fragile const &other) : value{other.value} {
+    pass();
+    ++live;
+  }
+  Fragile(Fragile &&other) : value{other.value} {
+    pass();
+    ++live;
+  }
+  ~Fragile() { --live; }
+
+  static void pass() {
+    if (passes_left == 0) {
+      throw std::runtime_error("fragile");
+    }
+    if (passes_left > 0) {
+      --passes_left;
+    }
+  }
+
+  int value;
+};
+
+TEST(StaticCacheTest, ThrowingCopiesLeakNothing) {
+  {
+    auto cache = lru::make_static_cache<3>([](const int x) { return Fragile{x}; });
+    for (int i = 0; i < 3; ++i) {
+      cache.get(i);
+    }
+    EXPECT_EQ(Fragile::live, 3);
+    // The copy of the second entry throws: the first one is destroyed
+    Fragile::passes_left = 1;
+    EXPECT_THROW({ auto copy = cache; }, std::runtime_error);
+    Fragile::passes_left = -1;
+    EXPECT_EQ(Fragile::live, 3);
+  }
+  EXPECT_EQ(Fragile::live, 0);
+}
+
+TEST(StaticCacheTest, ThrowingMovesKeepEntriesConsistent) {
+  {
+    auto cache = lru::make_static_cache<3>([](const int x) {
+      // Into the pair, then the move into the slot throws, and so would the
+      // move that fills its hole
+      Fragile::passes_left = x < 0 ? 1 : -1;
+      return Fragile{x};
+    });
+    for (int i = 0; i < 3; ++i) {
+      cache.get(i);
+    }
+    cache.get(1);
+    cache.get(2);
+    EXPECT_THROW(cache.get(-1), std::runtime_error);
+    Fragile::passes_left = -1;
+    // 0 was evicted: the entries after its slot are dropped instead of moved
+    EXPECT_EQ(cache.size(), 0u);
+    EXPECT_EQ(Fragile::live, 0);
+    EXPECT_EQ(cache.get(4).value, 4);
+    EXPECT_TRUE(cache.contains(4));
+  }
+  EXPECT_EQ(Fragile::live, 0);
+}
+
+TEST(StaticCacheTest, MoveOnlyValues) {
+  auto cache = lru::make_static_cache<2>([](const int x) { return std::make_unique<int>(x); });
+  EXPECT_EQ(*cache.get(1), 1);
+  EXPECT_EQ(*cache.get(2), 2);
+  EXPECT_EQ(*cache.get(3), 3);
+  EXPECT_FALSE(cache.contains(1));
+}
@@ -0,0 +1,188 @@
+#include "lru/tiered.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <gtest/gtest.h>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+std::atomic<unsigned> calls{0};
+
+// Runs tasks one at a time on a thread of its own, so that they share its L1
+class Worker {
+public:
+  Worker() : thread{[this] { work(); }} {}
+
+  ~Worker() {
+    run([this] { stopping = true; });
+    thread.join();
+  }
+
+  // Runs `task` on the worker and waits for it
+  void run(std::function<void()> task) {
+    std::unique_lock<std::mutex> lock{mutex};
+    pending = std::move(task);
+    changed.notify_all();
+    changed.wait(lock, [this] { return !pending; });
+  }
+
+private:
+  void work() {
+    std::unique_lock<std::mutex> lock{mutex};
+    while (!stopping) {
+      changed.wait(lock, [this] { return static_cast<bool>(pending); });
+      pending();
+      pending = nullptr;
+      changed.notify_all();
+    }
+  }
+
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::function<void()> pending;
+  bool stopping = false;
+  std::thread thread;
+};
+} // namespace
+
+long square(const int x) {
+  calls++;
+  return static_cast<long>(x) * x;
+}
+
+TEST(TieredCacheTest, BasicFunctionality) {
+  calls = 0;
+  auto cache = lru::make_tiered_cache(square, 100, 8);
+  for (int round = 0; round < 3; ++round) {
+    for (int i = 0; i < 50; ++i) {
+      EXPECT_EQ(cache(i), static_cast<long>(i) * i);
+    }
+  }
+  EXPECT_EQ(calls, 50u);
+  EXPECT_EQ(cache.thread_capacity(), 8u);
+  EXPECT_THROW(lru::make_tiered_cache(square, 100, 0), std::length_error);
+  EXPECT_THROW(lru::make_tiered_cache(square, 100, 8, 16), std::invalid_argument);
+}
+
+TEST(TieredCacheTest, HotKeysAreServedFromTheThreadTier) {
+  auto cache = lru::make_tiered_cache<lru::instrumented<>>(square, 100, 4, 3);
+  for (int i = 0; i < 10; ++i) {
+    cache(7);
+  }
+  // One miss and two L2 hits until the third request promotes the key
+  auto stats = cache.shared().stats();
+  EXPECT_EQ(stats.misses, 1u);
+  EXPECT_EQ(stats.hits, 2u);
+
+  // Keys asked for once never leave L2
+  for (int i = 0; i < 20; ++i) {
+    cache(100 + i);
+  }
+  cache(7);
+  stats = cache.shared().stats();
+  EXPECT_EQ(stats.misses, 21u);
+  EXPECT_EQ(stats.hits, 2u);
+}
+
+TEST(TieredCacheTest, InvalidationReachesEveryThread) {
+  std::atomic<long> source{1};
+  auto cache = lru::make_tiered_cache([&source](const int x) { return source * x; }, 100, 8);
+  Worker worker;
+  long seen = 0;
+  worker.run([&] { seen = cache(5); });
+  EXPECT_EQ(seen, 5);
+  EXPECT_EQ(cache(5), 5);
+
+  source = 2;
+  worker.run([&] { seen = cache(5); });
+  EXPECT_EQ(seen, 5); // still in the worker's tier
+
+  EXPECT_TRUE(cache.invalidate(5));
+  EXPECT_FALSE(cache.invalidate(6));
+  worker.run([&] { seen = cache(5); });
+  EXPECT_EQ(seen, 10);
+  EXPECT_EQ(cache(5), 10);
+
+  // A thread that fell behind by more than the log empties its tier
+  source = 3;
+  for (std::size_t i = 0; i <= decltype(cache)::invalidation_log; ++i) {
+    cache.invalidate(1000 + static_cast<int>(i));
+  }
+  cache.invalidate(5);
+  worker.run([&] { seen = cache(5); });
+  EXPECT_EQ(seen, 15);
+
+  source = 4;
+  cache.clear();
+  worker.run([&] { seen = cache(5); });
+  EXPECT_EQ(seen, 20);
+  EXPECT_EQ(cache(5), 20);
+}
+
+TEST(TieredCacheTest, ConcurrentReadersAndInvalidations) {
+  constexpr int keys = 32;
+  std::atomic<long> version[keys] = {};
+  auto cache = lru::make_tiered_cache([&version](const int x) { return version[x] * 1000 + x; }, 256, 16);
+
+  // 0: readers churn, 1: writes are over, 2: the last invalidations are done
+  std::atomic<int> phase{0};
+  std::atomic<int> parked{0};
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; ++t) {
+    readers.emplace_back([&, t] {
+      for (int i = 0; phase == 0; ++i) {
+        const int key = (i + t) % keys;
+        EXPECT_EQ(cache(key) % 1000, key);
+      }
+      parked++;
+      while (phase != 2) {
+        std::this_thread::yield();
+      }
+      // Misses racing with the writer may have cached old values in L2, but
+      // the last invalidations came after them
+      for (int key = 0; key < keys; ++key) {
+        EXPECT_EQ(cache(key), version[key] * 1000 + key);
+      }
+    });
+  }
+  for (int round = 0; round < 2000; ++round) {
+    version[round % keys]++;
+    cache.invalidate(round % keys);
+    if (round % 500 == 0) {
+      cache.clear();
+    }
+  }
+  phase = 1;
+  while (parked != 4) {
+    std::this_thread::yield();
+  }
+  for (int key = 0; key < keys; ++key) {
+    cache.invalidate(key);
+  }
+  phase = 2;
+  for (auto &reader : readers) {
+    reader.join();
+  }
+}
+
+TEST(TieredCacheTest, ExitedThreadsReleaseTheirTiers) {
+  auto cache = lru::make_tiered_cache([](const int x) { return x + 1; }, 64, 8);
+  EXPECT_EQ(cache(0), 1);
+  for (int t = 0; t < 32; ++t) {
+    std::thread{[&cache, t] { EXPECT_EQ(cache(t), t + 1); }}.join();
+  }
+  EXPECT_EQ(cache.thread_tiers(), 1u);
+
+  // A thread may outlive the cache it looked up
+  Worker worker;
+  auto doomed = std::make_unique<lru::TieredCache<int, int>>([](const int x) { return x * 2; }, 64, 8);
+  worker.run([&] { EXPECT_EQ((*doomed)(3), 6); });
+  EXPECT_EQ(doomed->thread_tiers(), 1u);
+  doomed.reset();
+  worker.run([&] { EXPECT_EQ(cache(4), 5); });
+}